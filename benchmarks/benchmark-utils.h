@@ -0,0 +1,135 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace benchmark
+{
+
+/// Iterate the default main context until test() passes or timeout_msec elapses
+inline bool run_until(const std::function<bool()>& test, guint timeout_msec = 10000)
+{
+    // wake up now and then to check the deadline
+    auto keepalive = [](gpointer) -> gboolean
+    {
+        return G_SOURCE_CONTINUE;
+    };
+    const auto keepalive_tag = g_timeout_add(10, keepalive, nullptr);
+
+    const auto deadline = g_get_monotonic_time() + gint64(timeout_msec) * 1000;
+    while (!test() && (g_get_monotonic_time() < deadline))
+    {
+        g_main_context_iteration(nullptr, true);
+    }
+
+    g_source_remove(keepalive_tag);
+    return test();
+}
+
+/// Summary statistics of a set of samples, in usec
+struct Distribution
+{
+    explicit Distribution(std::vector<gint64> samples)
+    {
+        std::sort(samples.begin(), samples.end());
+        n = samples.size();
+        if (n == 0)
+        {
+            return;
+        }
+
+        min = samples.front();
+        max = samples.back();
+        double sum = 0;
+        for (const auto& sample : samples)
+        {
+            sum += sample;
+        }
+        mean = sum / n;
+        p50 = percentile(samples, 0.50);
+        p90 = percentile(samples, 0.90);
+        p99 = percentile(samples, 0.99);
+        p999 = percentile(samples, 0.999);
+    }
+
+    size_t n{0};
+    gint64 min{0};
+    gint64 max{0};
+    double mean{0};
+    gint64 p50{0};
+    gint64 p90{0};
+    gint64 p99{0};
+    gint64 p999{0};
+
+    std::string to_json() const
+    {
+        gchar* str = g_strdup_printf("{\"n\": %zu, \"min\": %" G_GINT64_FORMAT ", \"mean\": %.1f, \"p50\": %" G_GINT64_FORMAT
+                                     ", \"p90\": %" G_GINT64_FORMAT ", \"p99\": %" G_GINT64_FORMAT
+                                     ", \"p999\": %" G_GINT64_FORMAT ", \"max\": %" G_GINT64_FORMAT "}",
+                                     n, min, mean, p50, p90, p99, p999, max);
+        std::string ret{str};
+        g_free(str);
+        return ret;
+    }
+
+    void print(const char* name) const
+    {
+        g_print("%s (usec, n=%zu): min %" G_GINT64_FORMAT "  p50 %" G_GINT64_FORMAT "  p90 %" G_GINT64_FORMAT
+                "  p99 %" G_GINT64_FORMAT "  p999 %" G_GINT64_FORMAT "  max %" G_GINT64_FORMAT "\n",
+                name, n, min, p50, p90, p99, p999, max);
+    }
+
+private:
+    static gint64 percentile(const std::vector<gint64>& sorted, double p)
+    {
+        auto idx = size_t(std::ceil(p * sorted.size()));
+        return sorted[std::min(sorted.size(), std::max(size_t(1), idx)) - 1];
+    }
+};
+
+/// Write 'json' to 'filename', or to stdout if filename is null
+inline bool write_json(const char* filename, const std::string& json)
+{
+    if (filename == nullptr)
+    {
+        g_print("%s\n", json.c_str());
+        return true;
+    }
+
+    GError* error = nullptr;
+    if (!g_file_set_contents(filename, json.c_str(), json.size(), &error))
+    {
+        g_printerr("Couldn't write '%s': %s\n", filename, error->message);
+        g_error_free(error);
+        return false;
+    }
+
+    g_print("Wrote %s\n", filename);
+    return true;
+}
+
+}  // namespace benchmark
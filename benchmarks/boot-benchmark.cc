@@ -0,0 +1,251 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+/**
+ * Compares the indicator's boot-time footprint with and without --lazy.
+ *
+ * Each run gets a fresh bus on which location-service-mock is
+ * D-Bus-activatable, as the real location service is on a device.
+ * We time how long the indicator takes to own its name, whether it
+ * started the location service, and how long until it has real values:
+ * right away for an eager controller, and after the menu is first
+ * opened for a lazy one.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <signal.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmarks/benchmark-utils.h"
+#include "src/dbus-shared.h"
+#include "src/location-service-controller.h"
+#include "src/service.h"
+
+namespace
+{
+const char* const LOCATION_BUS_NAME{"com.ubuntu.location.Service"};
+
+struct Results
+{
+    std::vector<gint64> ready;      // launch -> indicator owns its bus name
+    std::vector<gint64> valid;      // launch (or menu open, if lazy) -> real values
+    unsigned int n_activations{0};  // runs that started the location service
+    unsigned int n_runs{0};
+};
+
+void on_indicator_appeared(GDBusConnection*, const gchar*, const gchar*, gpointer gwhen)
+{
+    *static_cast<gint64*>(gwhen) = g_get_monotonic_time();
+}
+
+// the owner's pid, or 0 if the name has no owner
+guint32 get_name_owner_pid(GDBusConnection* bus, const char* name)
+{
+    auto v = g_dbus_connection_call_sync(bus, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+                                         "GetConnectionUnixProcessID", g_variant_new("(s)", name),
+                                         G_VARIANT_TYPE("(u)"), G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
+    guint32 pid = 0;
+    if (v != nullptr)
+    {
+        g_variant_get(v, "(u)", &pid);
+        g_variant_unref(v);
+    }
+    return pid;
+}
+
+bool run_once(bool lazy, const char* service_dir, Results& results)
+{
+    // unset so that the activated mock will use DBUS_STARTER_ADDRESS
+    // instead of inheriting the last run's bus from the daemon
+    g_unsetenv("DBUS_SYSTEM_BUS_ADDRESS");
+
+    auto test_dbus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_add_service_dir(test_dbus, service_dir);
+    g_test_dbus_up(test_dbus);
+    const auto address = g_test_dbus_get_bus_address(test_dbus);
+    g_setenv("DBUS_SYSTEM_BUS_ADDRESS", address, true);
+
+    // the shell, on its own connection
+    GError* error = nullptr;
+    auto flags = GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                      G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION);
+    auto client = g_dbus_connection_new_for_address_sync(address, flags, nullptr, nullptr, &error);
+    g_assert_no_error(error);
+    gint64 appeared_at = 0;
+    auto watch_tag = g_bus_watch_name_on_connection(client, INDICATOR_BUS_NAME, G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                    on_indicator_appeared, nullptr, &appeared_at, nullptr);
+
+    // launch
+    const auto launched_at = g_get_monotonic_time();
+    auto controller = std::make_shared<LocationServiceController>(lazy);
+    std::unique_ptr<Service> service(new Service(controller));
+    bool ok = benchmark::run_until([&appeared_at]()
+                                   {
+                                       return appeared_at != 0;
+                                   });
+    if (ok)
+    {
+        results.ready.push_back(appeared_at - launched_at);
+    }
+
+    // an eager controller should become valid without any help
+    if (ok && !lazy)
+    {
+        ok = benchmark::run_until([&controller]()
+                                  {
+                                      return controller->is_valid().get();
+                                  });
+        results.valid.push_back(g_get_monotonic_time() - launched_at);
+    }
+
+    // give a lazy one the chance to misbehave, then open the menu
+    GDBusMenuModel* menu = nullptr;
+    if (ok && lazy)
+    {
+        benchmark::run_until([]()
+                             {
+                                 return false;
+                             },
+                             500);
+        if (get_name_owner_pid(client, LOCATION_BUS_NAME) != 0)
+        {
+            ++results.n_activations;
+        }
+
+        const auto opened_at = g_get_monotonic_time();
+        menu = g_dbus_menu_model_get(client, INDICATOR_BUS_NAME, INDICATOR_OBJECT_PATH "/phone");
+        g_menu_model_get_n_items(G_MENU_MODEL(menu));
+        ok = benchmark::run_until([&controller]()
+                                  {
+                                      return controller->is_valid().get();
+                                  });
+        results.valid.push_back(g_get_monotonic_time() - opened_at);
+    }
+    else if (ok && (get_name_owner_pid(client, LOCATION_BUS_NAME) != 0))
+    {
+        ++results.n_activations;
+    }
+    ++results.n_runs;
+
+    // the activated service doesn't exit when the bus goes away
+    const auto pid = get_name_owner_pid(client, LOCATION_BUS_NAME);
+    if (pid != 0)
+    {
+        kill(pid_t(pid), SIGTERM);
+    }
+
+    g_clear_object(&menu);
+    g_bus_unwatch_name(watch_tag);
+    g_dbus_connection_close_sync(client, nullptr, nullptr);
+    g_object_unref(client);
+    service.reset();
+    controller.reset();
+    g_test_dbus_down(test_dbus);
+    g_object_unref(test_dbus);
+    return ok;
+}
+}
+
+int main(int argc, char** argv)
+{
+    gint iterations = 10;
+    gchar* mock_path = nullptr;
+    gchar* json_filename = nullptr;
+    GOptionEntry entries[] = {
+        {"iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Launches to time in each mode (default: 10)", "N"},
+        {"mock", 0, 0, G_OPTION_ARG_FILENAME, &mock_path, "Path to the location-service-mock executable", "PATH"},
+        {"json", 0, 0, G_OPTION_ARG_FILENAME, &json_filename, "Write the results here as JSON", "FILE"},
+        {nullptr}};
+
+    GError* error = nullptr;
+    GOptionContext* context = g_option_context_new(nullptr);
+    g_option_context_add_main_entries(context, entries, nullptr);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+    if (mock_path == nullptr)
+    {
+        g_printerr("--mock is required\n");
+        return 1;
+    }
+
+    // make the mock activatable, the way the real location service is
+    auto service_dir = g_dir_make_tmp("indicator-location-boot-XXXXXX", &error);
+    g_assert_no_error(error);
+    auto service_file = g_build_filename(service_dir, "com.ubuntu.location.Service.service", nullptr);
+    auto contents = g_strdup_printf("[D-BUS Service]\nName=%s\nExec=%s --online\n", LOCATION_BUS_NAME, mock_path);
+    g_file_set_contents(service_file, contents, -1, &error);
+    g_assert_no_error(error);
+    g_free(contents);
+
+    std::string json = "{\"benchmark\": \"boot\"";
+    bool ok = true;
+    for (const bool lazy : {false, true})
+    {
+        const char* mode = lazy ? "lazy" : "eager";
+        Results results;
+        for (int i = 0; ok && i < iterations; ++i)
+        {
+            ok = run_once(lazy, service_dir, results);
+        }
+        if (!ok)
+        {
+            g_printerr("%s: timed out\n", mode);
+            break;
+        }
+
+        const benchmark::Distribution ready(results.ready);
+        const benchmark::Distribution valid(results.valid);
+        g_print("%s: location service started in %u of %u runs\n", mode, results.n_activations, results.n_runs);
+        ready.print(lazy ? "  lazy: launch -> name owned" : "  eager: launch -> name owned");
+        valid.print(lazy ? "  lazy: menu opened -> real values" : "  eager: launch -> real values");
+
+        gchar* mode_json = g_strdup_printf(", \"%s\": {\"activations\": %u, \"runs\": %u, \"ready_usec\": %s, "
+                                           "\"valid_usec\": %s}",
+                                           mode, results.n_activations, results.n_runs, ready.to_json().c_str(),
+                                           valid.to_json().c_str());
+        json += mode_json;
+        g_free(mode_json);
+    }
+    json += "}";
+    if (ok)
+    {
+        ok = benchmark::write_json(json_filename, json);
+    }
+
+    // cleanup
+    g_remove(service_file);
+    g_rmdir(service_dir);
+    g_free(service_file);
+    g_free(service_dir);
+    g_free(mock_path);
+    g_free(json_filename);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+/**
+ * How much work turning the display off saves.
+ *
+ * Runs the same scripted workload -- an app polling for a position, which
+ * flips the location service between active and idle -- once with the
+ * display on and once with it off, and counts the header emissions that
+ * reach a shell-side client and the update passes Phone makes. With the
+ * display off there should be none until it comes back on, and then one.
+ *
+ * Everything runs against a private GTestDBus, with LocationServiceMock
+ * and UnityScreenMock standing in for the location & screen services.
+ */
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <memory>
+#include <string>
+
+#include "benchmarks/benchmark-utils.h"
+#include "src/dbus-shared.h"
+#include "src/location-service-controller.h"
+#include "src/service.h"
+#include "src/unity-screen-display-state.h"
+#include "tests/location-service-mock.h"
+#include "tests/unity-screen-mock.h"
+
+namespace
+{
+void on_header_changed(GActionGroup*, const gchar*, GVariant*, gpointer gcount)
+{
+    ++*static_cast<unsigned int*>(gcount);
+}
+
+struct Counts
+{
+    unsigned int header_emissions{0};  // seen by the shell
+    unsigned int flushes{0};           // Phone's update passes
+};
+}
+
+int main(int argc, char** argv)
+{
+    gint events = 200;
+    gint events_per_sec = 50;
+    gchar* json_filename = nullptr;
+    GOptionEntry entries[] = {
+        {"events", 'n', 0, G_OPTION_ARG_INT, &events, "State flips in each phase (default: 200)", "N"},
+        {"rate", 0, 0, G_OPTION_ARG_INT, &events_per_sec, "State flips per second (default: 50)", "N"},
+        {"json", 0, 0, G_OPTION_ARG_FILENAME, &json_filename, "Write the results here as JSON", "FILE"},
+        {nullptr}};
+
+    GError* error = nullptr;
+    GOptionContext* context = g_option_context_new(nullptr);
+    g_option_context_add_main_entries(context, entries, nullptr);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    // a private bus that plays both the system & session bus
+    auto test_dbus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(test_dbus);
+    const auto address = g_test_dbus_get_bus_address(test_dbus);
+    g_setenv("DBUS_SYSTEM_BUS_ADDRESS", address, true);
+
+    // the location & screen services
+    std::unique_ptr<LocationServiceMock> location_service(new LocationServiceMock(address));
+    location_service->set_is_online(true);
+    location_service->own_name();
+    std::unique_ptr<UnityScreenMock> screen(new UnityScreenMock(address));
+    screen->own_name();
+
+    // the indicator
+    auto controller = std::make_shared<LocationServiceController>();
+    std::unique_ptr<Service> service(new Service(controller));
+    auto display_state = std::make_shared<UnityScreenDisplayState>();
+    auto& phone = service->get_phone_profile();
+    phone.set_display_state(display_state);
+
+    // the shell, on its own connection
+    auto flags = GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                      G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION);
+    auto bus = g_dbus_connection_new_for_address_sync(address, flags, nullptr, nullptr, &error);
+    g_assert_no_error(error);
+    auto actions = g_dbus_action_group_get(bus, INDICATOR_BUS_NAME, INDICATOR_OBJECT_PATH);
+    auto menu = g_dbus_menu_model_get(bus, INDICATOR_BUS_NAME, INDICATOR_OBJECT_PATH "/phone");
+    unsigned int header_emissions = 0;
+    g_signal_connect(actions, "action-state-changed::phone-header", G_CALLBACK(on_header_changed), &header_emissions);
+
+    // wait for everything to be up
+    const bool ready = benchmark::run_until([&]()
+                                            {
+                                                g_strfreev(g_action_group_list_actions(G_ACTION_GROUP(actions)));
+                                                g_menu_model_get_n_items(G_MENU_MODEL(menu));
+                                                return controller->is_valid().get() &&
+                                                       g_action_group_has_action(G_ACTION_GROUP(actions),
+                                                                                 "phone-header");
+                                            });
+    if (!ready)
+    {
+        g_printerr("Timed out waiting for the indicator to come up\n");
+        return 1;
+    }
+    auto settle = []()
+    {
+        benchmark::run_until([]()
+                             {
+                                 return false;
+                             },
+                             200);
+    };
+    settle();
+
+    // run the workload and count what it cost
+    auto run_phase = [&]()
+    {
+        const auto emissions_before = header_emissions;
+        const auto flushes_before = phone.update_stats().flushes;
+        location_service->start_storm(LocationServiceMock::PROP_KEY_LOC_STATE, events_per_sec, events);
+        benchmark::run_until([&]()
+                             {
+                                 return location_service->storm_remaining() == 0;
+                             },
+                             60000);
+        settle();
+        Counts counts;
+        counts.header_emissions = header_emissions - emissions_before;
+        counts.flushes = phone.update_stats().flushes - flushes_before;
+        return counts;
+    };
+
+    const auto on = run_phase();
+    g_print("display on:  %u header emissions, %u update passes\n", on.header_emissions, on.flushes);
+
+    screen->set_display_on(false);
+    settle();
+    const auto off = run_phase();
+    g_print("display off: %u header emissions, %u update passes\n", off.header_emissions, off.flushes);
+
+    // make sure the state changed while we were off so that waking has something to publish
+    location_service->flip(LocationServiceMock::PROP_KEY_LOC_STATE);
+    settle();
+    const auto emissions_before_wake = header_emissions;
+    const auto flushes_before_wake = phone.update_stats().flushes;
+    screen->set_display_on(true);
+    settle();
+    Counts wake;
+    wake.header_emissions = header_emissions - emissions_before_wake;
+    wake.flushes = phone.update_stats().flushes - flushes_before_wake;
+    g_print("on wake:     %u header emissions, %u update passes\n", wake.header_emissions, wake.flushes);
+    const int saved = int(on.header_emissions) - int(off.header_emissions + wake.header_emissions);
+    g_print("saved %d of %u shell wakeups\n", saved, on.header_emissions);
+
+    // report
+    auto counts_to_json = [](const Counts& counts)
+    {
+        gchar* str =
+            g_strdup_printf("{\"header_emissions\": %u, \"flushes\": %u}", counts.header_emissions, counts.flushes);
+        std::string ret{str};
+        g_free(str);
+        return ret;
+    };
+    gchar* workload = g_strdup_printf("{\"events\": %d, \"events_per_sec\": %d}", events, events_per_sec);
+    const std::string json = std::string("{\"benchmark\": \"display\", \"workload\": ") + workload +
+                             ", \"display_on\": " + counts_to_json(on) + ", \"display_off\": " + counts_to_json(off) +
+                             ", \"wake\": " + counts_to_json(wake) + "}";
+    g_free(workload);
+    bool ok = benchmark::write_json(json_filename, json);
+
+    // with the display off, we expect nothing until it comes back on, and then just one pass
+    if ((off.header_emissions != 0) || (wake.flushes != 1))
+    {
+        g_printerr("Expected no emissions while the display was off and one update pass on wake\n");
+        ok = false;
+    }
+
+    // cleanup
+    g_object_unref(menu);
+    g_object_unref(actions);
+    g_dbus_connection_close_sync(bus, nullptr, nullptr);
+    g_object_unref(bus);
+    service.reset();
+    display_state.reset();
+    controller.reset();
+    screen.reset();
+    location_service.reset();
+    g_test_dbus_down(test_dbus);
+    g_object_unref(test_dbus);
+    g_free(json_filename);
+    return ok ? 0 : 1;
+}
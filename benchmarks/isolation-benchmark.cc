@@ -0,0 +1,243 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+/**
+ * Checks that system bus load doesn't reach the shell: while the
+ * location service is quiet and then while it storms PropertiesChanged
+ * with slow replies, a shell-side client keeps calling the indicator's
+ * org.gtk.Actions.DescribeAll and we time the round trips.
+ *
+ * location-service-mock runs in a process of its own so that its side
+ * of the storm doesn't land on our main loop. Both phases should have
+ * about the same latency; whatever the storm still costs us is the state
+ * handed over to the main thread, which is reported too.
+ */
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <signal.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmarks/benchmark-utils.h"
+#include "src/dbus-shared.h"
+#include "src/location-service-controller.h"
+#include "src/metrics.h"
+#include "src/service.h"
+
+namespace
+{
+struct Probe
+{
+    gint64 sent_at{0};
+    gint64 replied_at{0};
+};
+
+void on_describe_all_reply(GObject* connection, GAsyncResult* res, gpointer gprobe)
+{
+    auto v = g_dbus_connection_call_finish(G_DBUS_CONNECTION(connection), res, nullptr);
+    if (v != nullptr)
+    {
+        g_variant_unref(v);
+    }
+    static_cast<Probe*>(gprobe)->replied_at = g_get_monotonic_time();
+}
+
+// one shell-side round trip; returns its latency in usec, or -1 on timeout
+gint64 probe_once(GDBusConnection* client)
+{
+    Probe probe;
+    probe.sent_at = g_get_monotonic_time();
+    g_dbus_connection_call(client, INDICATOR_BUS_NAME, INDICATOR_OBJECT_PATH, "org.gtk.Actions", "DescribeAll",
+                           nullptr, G_VARIANT_TYPE("(a{s(bgav)})"), G_DBUS_CALL_FLAGS_NONE, -1, nullptr,
+                           on_describe_all_reply, &probe);
+    if (!benchmark::run_until([&probe]()
+                              {
+                                  return probe.replied_at != 0;
+                              }))
+    {
+        return -1;
+    }
+    return probe.replied_at - probe.sent_at;
+}
+
+void pause_msec(guint msec)
+{
+    benchmark::run_until([]()
+                         {
+                             return false;
+                         },
+                         msec);
+}
+}
+
+int main(int argc, char** argv)
+{
+    gint storm_rate = 5000;
+    gint storm_count = 20000;
+    gint reply_delay_msec = 200;
+    gint probe_interval_msec = 5;
+    gchar* mock_path = nullptr;
+    gchar* json_filename = nullptr;
+    GOptionEntry entries[] = {
+        {"storm-rate", 0, 0, G_OPTION_ARG_INT, &storm_rate, "Storm events per second (default: 5000)", "N"},
+        {"storm-count", 0, 0, G_OPTION_ARG_INT, &storm_count, "Storm events in total (default: 20000)", "N"},
+        {"reply-delay", 0, 0, G_OPTION_ARG_INT, &reply_delay_msec, "Delay the mock's replies (default: 200)", "MSEC"},
+        {"interval", 0, 0, G_OPTION_ARG_INT, &probe_interval_msec, "Pause between probes (default: 5)", "MSEC"},
+        {"mock", 0, 0, G_OPTION_ARG_FILENAME, &mock_path, "Path to the location-service-mock executable", "PATH"},
+        {"json", 0, 0, G_OPTION_ARG_FILENAME, &json_filename, "Write the results here as JSON", "FILE"},
+        {nullptr}};
+
+    GError* error = nullptr;
+    GOptionContext* context = g_option_context_new(nullptr);
+    g_option_context_add_main_entries(context, entries, nullptr);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+    if (mock_path == nullptr)
+    {
+        g_printerr("--mock is required\n");
+        return 1;
+    }
+
+    // a private bus that plays both the system & session bus
+    auto test_dbus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(test_dbus);
+    const auto address = g_test_dbus_get_bus_address(test_dbus);
+    g_setenv("DBUS_SYSTEM_BUS_ADDRESS", address, true);
+
+    // the location service; it inherits the bus address from us.
+    // the quiet phase is the time before its storm starts.
+    constexpr gint quiet_msec = 3000;
+    auto rate_arg = g_strdup_printf("--storm-rate=%d", storm_rate);
+    auto count_arg = g_strdup_printf("--storm-count=%d", storm_count);
+    auto start_arg = g_strdup_printf("--storm-start=%d", quiet_msec);
+    auto delay_arg = g_strdup_printf("--reply-delay=%d", reply_delay_msec);
+    gchar* mock_argv[] = {mock_path, const_cast<gchar*>("--online"), const_cast<gchar*>("--storm-property=State"),
+                          rate_arg, count_arg, start_arg, delay_arg, nullptr};
+    GPid mock_pid = 0;
+    g_spawn_async(nullptr, mock_argv, nullptr, G_SPAWN_DEFAULT, nullptr, nullptr, &mock_pid, &error);
+    g_assert_no_error(error);
+
+    // the indicator
+    auto controller = std::make_shared<LocationServiceController>();
+    std::unique_ptr<Service> service(new Service(controller));
+    unsigned int n_changes = 0;
+    auto on_active_changed = [&n_changes](bool)
+    {
+        ++n_changes;
+    };
+    core::ScopedConnection connection = controller->location_service_active().changed().connect(on_active_changed);
+
+    // the shell, on its own connection
+    auto flags = GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                      G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION);
+    auto client = g_dbus_connection_new_for_address_sync(address, flags, nullptr, nullptr, &error);
+    g_assert_no_error(error);
+
+    bool ok = benchmark::run_until([&controller]()
+                                   {
+                                       return controller->is_valid().get();
+                                   });
+    if (!ok)
+    {
+        g_printerr("Timed out waiting for the indicator to come up\n");
+    }
+
+    // quiet: until the first flip of the storm reaches us
+    std::vector<gint64> quiet;
+    while (ok && (n_changes == 0))
+    {
+        const auto latency = probe_once(client);
+        ok = latency >= 0;
+        quiet.push_back(latency);
+        pause_msec(probe_interval_msec);
+    }
+
+    // storm: until the last flip does. Keep toggling GPS too, so that
+    // there are always Sets waiting on the mock's slow replies
+    Metrics::get().reset();
+    std::vector<gint64> storm;
+    bool gps = controller->gps_enabled().get();
+    const auto storm_start = g_get_monotonic_time();
+    const auto storm_deadline = storm_start + 60 * G_USEC_PER_SEC;
+    while (ok && (n_changes < guint(storm_count)) && (g_get_monotonic_time() < storm_deadline))
+    {
+        const auto latency = probe_once(client);
+        ok = latency >= 0;
+        storm.push_back(latency);
+        gps = !gps;
+        controller->set_gps_enabled(gps);
+        pause_msec(probe_interval_msec);
+    }
+    const auto storm_usec = g_get_monotonic_time() - storm_start;
+    if (!ok)
+    {
+        g_printerr("Timed out waiting for a DescribeAll reply\n");
+    }
+
+    // report
+    const benchmark::Distribution quiet_latency(quiet);
+    const benchmark::Distribution storm_latency(storm);
+    quiet_latency.print("quiet: DescribeAll round trip");
+    storm_latency.print("storm: DescribeAll round trip");
+    const auto& handoff = Metrics::get().histogram(Metrics::STAGE_THREAD_HANDOFF);
+    const double handoff_mean = handoff.count() > 0 ? handoff.sum() / 1000.0 / handoff.count() : 0;
+    g_print("storm: %u flips in %.3f sec reached the main thread in %" G_GUINT64_FORMAT
+            " snapshots; handoff mean %.1f usec, max %.1f usec\n",
+            n_changes, storm_usec / double(G_USEC_PER_SEC), handoff.count(), handoff_mean, handoff.max() / 1000.0);
+
+    gchar* storm_json = g_strdup_printf("{\"flips\": %u, \"usec\": %" G_GINT64_FORMAT
+                                        ", \"snapshots\": %" G_GUINT64_FORMAT
+                                        ", \"handoff_mean_usec\": %.1f, \"handoff_max_usec\": %.1f}",
+                                        n_changes, storm_usec, handoff.count(), handoff_mean, handoff.max() / 1000.0);
+    const std::string json = std::string("{\"benchmark\": \"isolation\", \"quiet_usec\": ") +
+                             quiet_latency.to_json() + ", \"storm_usec\": " + storm_latency.to_json() +
+                             ", \"storm\": " + storm_json + "}";
+    g_free(storm_json);
+    if (ok)
+    {
+        ok = benchmark::write_json(json_filename, json);
+    }
+
+    // cleanup
+    kill(mock_pid, SIGTERM);
+    g_spawn_close_pid(mock_pid);
+    g_dbus_connection_close_sync(client, nullptr, nullptr);
+    g_object_unref(client);
+    service.reset();
+    controller.reset();
+    g_test_dbus_down(test_dbus);
+    g_object_unref(test_dbus);
+    g_free(delay_arg);
+    g_free(start_arg);
+    g_free(count_arg);
+    g_free(rate_arg);
+    g_free(mock_path);
+    g_free(json_filename);
+    return ok ? 0 : 1;
+}
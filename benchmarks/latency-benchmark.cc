@@ -0,0 +1,193 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+/**
+ * Measures the path we care about most: the location service emitting
+ * PropertiesChanged on the system bus, through LocationServiceController
+ * and Phone, to a shell-side GDBusActionGroup seeing action-state-changed
+ * for the header on the session bus.
+ *
+ * Everything runs against a private GTestDBus, with LocationServiceMock
+ * standing in for the location service.
+ */
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmarks/benchmark-utils.h"
+#include "src/dbus-shared.h"
+#include "src/location-service-controller.h"
+#include "src/service.h"
+#include "tests/location-service-mock.h"
+
+namespace
+{
+struct Client
+{
+    GDBusConnection* bus{};
+    GDBusActionGroup* actions{};
+    GDBusMenuModel* menu{};
+    unsigned int header_changes{0};
+    gint64 last_header_change{0};
+};
+
+void on_header_changed(GActionGroup*, const gchar*, GVariant*, gpointer gclient)
+{
+    auto client = static_cast<Client*>(gclient);
+    client->last_header_change = g_get_monotonic_time();
+    ++client->header_changes;
+}
+}
+
+int main(int argc, char** argv)
+{
+    gint iterations = 1000;
+    gint storm_count = 10000;
+    gchar* json_filename = nullptr;
+    GOptionEntry entries[] = {
+        {"iterations", 'n', 0, G_OPTION_ARG_INT, &iterations, "Round trips to time (default: 1000)", "N"},
+        {"storm-count", 0, 0, G_OPTION_ARG_INT, &storm_count, "Events in the throughput storm (default: 10000)", "N"},
+        {"json", 0, 0, G_OPTION_ARG_FILENAME, &json_filename, "Write the results here as JSON", "FILE"},
+        {nullptr}};
+
+    GError* error = nullptr;
+    GOptionContext* context = g_option_context_new(nullptr);
+    g_option_context_add_main_entries(context, entries, nullptr);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    // a private bus that plays both the system & session bus
+    auto test_dbus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(test_dbus);
+    const auto address = g_test_dbus_get_bus_address(test_dbus);
+    g_setenv("DBUS_SYSTEM_BUS_ADDRESS", address, true);
+
+    // the location service
+    std::unique_ptr<LocationServiceMock> location_service(new LocationServiceMock(address));
+    location_service->set_is_online(true);
+    location_service->own_name();
+
+    // the indicator
+    auto controller = std::make_shared<LocationServiceController>();
+    std::unique_ptr<Service> service(new Service(controller));
+
+    // the shell, on its own connection
+    Client client;
+    auto flags = GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                      G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION);
+    client.bus = g_dbus_connection_new_for_address_sync(address, flags, nullptr, nullptr, &error);
+    g_assert_no_error(error);
+    client.actions = g_dbus_action_group_get(client.bus, INDICATOR_BUS_NAME, INDICATOR_OBJECT_PATH);
+    client.menu = g_dbus_menu_model_get(client.bus, INDICATOR_BUS_NAME, INDICATOR_OBJECT_PATH "/phone");
+    g_signal_connect(client.actions, "action-state-changed::phone-header", G_CALLBACK(on_header_changed), &client);
+
+    // wait for everything to be up
+    const bool ready = benchmark::run_until([&]()
+                                            {
+                                                g_strfreev(g_action_group_list_actions(G_ACTION_GROUP(client.actions)));
+                                                g_menu_model_get_n_items(G_MENU_MODEL(client.menu));
+                                                return controller->is_valid().get() &&
+                                                       g_action_group_has_action(G_ACTION_GROUP(client.actions),
+                                                                                 "phone-header");
+                                            });
+    if (!ready)
+    {
+        g_printerr("Timed out waiting for the indicator to come up\n");
+        return 1;
+    }
+    benchmark::run_until([]()
+                         {
+                             return false;
+                         },
+                         200);
+
+    // latency: one PropertiesChanged at a time, timed until the shell sees it
+    std::vector<gint64> latencies;
+    latencies.reserve(iterations);
+    for (int i = 0; i < iterations; ++i)
+    {
+        const auto n_changes = client.header_changes;
+        const auto start = g_get_monotonic_time();
+        location_service->flip(LocationServiceMock::PROP_KEY_LOC_STATE);
+        if (!benchmark::run_until([&]()
+                                  {
+                                      return client.header_changes != n_changes;
+                                  }))
+        {
+            g_printerr("Timed out waiting for a header change\n");
+            return 1;
+        }
+        latencies.push_back(client.last_header_change - start);
+    }
+    const benchmark::Distribution latency(latencies);
+    latency.print("PropertiesChanged -> action-state-changed");
+
+    // throughput: a storm as fast as the service can emit it
+    unsigned int n_received = 0;
+    auto on_active_changed = [&n_received](bool)
+    {
+        ++n_received;
+    };
+    core::ScopedConnection connection = controller->location_service_active().changed().connect(on_active_changed);
+    const auto n_header_changes_before = client.header_changes;
+    const auto storm_start = g_get_monotonic_time();
+    location_service->start_storm(LocationServiceMock::PROP_KEY_LOC_STATE, 1000000, storm_count);
+    benchmark::run_until([&]()
+                         {
+                             return n_received >= guint(storm_count);
+                         },
+                         60000);
+    const auto storm_usec = g_get_monotonic_time() - storm_start;
+    const double events_per_sec = n_received / (storm_usec / double(G_USEC_PER_SEC));
+    const auto n_header_changes = client.header_changes - n_header_changes_before;
+    g_print("sustained: %u events in %.3f sec = %.0f events/sec; %u header emissions reached the shell\n",
+            n_received, storm_usec / double(G_USEC_PER_SEC), events_per_sec, n_header_changes);
+
+    // report
+    gchar* throughput_json = g_strdup_printf("{\"events\": %u, \"usec\": %" G_GINT64_FORMAT
+                                             ", \"events_per_sec\": %.1f, \"header_emissions\": %u}",
+                                             n_received, storm_usec, events_per_sec, n_header_changes);
+    const std::string json = std::string("{\"benchmark\": \"latency\", \"latency_usec\": ") + latency.to_json() +
+                             ", \"throughput\": " + throughput_json + "}";
+    g_free(throughput_json);
+    const bool written = benchmark::write_json(json_filename, json);
+
+    // cleanup
+    g_object_unref(client.menu);
+    g_object_unref(client.actions);
+    g_dbus_connection_close_sync(client.bus, nullptr, nullptr);
+    g_object_unref(client.bus);
+    service.reset();
+    controller.reset();
+    location_service.reset();
+    g_test_dbus_down(test_dbus);
+    g_object_unref(test_dbus);
+    g_free(json_filename);
+    return written ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+/**
+ * What --idle-exit costs the shell: times a client's first call to the
+ * indicator when it's resident and when the bus has to activate it again
+ * after it exited for being idle.
+ *
+ * Both modes run the real service binary against a private bus with a
+ * stand-in location service. The activated instance is started by the bus
+ * from a generated .service file, the same way the installed one would be.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmarks/benchmark-utils.h"
+#include "src/dbus-shared.h"
+#include "tests/location-service-mock.h"
+
+namespace
+{
+struct Options
+{
+    gint iterations{10};
+    gchar* service_path{nullptr};
+    gchar* json_filename{nullptr};
+};
+
+void on_indicator_appeared(GDBusConnection*, const gchar*, const gchar*, gpointer gowned)
+{
+    *static_cast<bool*>(gowned) = true;
+}
+
+void on_indicator_vanished(GDBusConnection*, const gchar*, gpointer gowned)
+{
+    *static_cast<bool*>(gowned) = false;
+}
+
+void on_describe_reply(GObject* source, GAsyncResult* res, gpointer gwhen)
+{
+    GError* error = nullptr;
+    auto v = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+    if (error != nullptr)
+    {
+        g_warning("DescribeAll failed: %s", error->message);
+        g_error_free(error);
+    }
+    g_clear_pointer(&v, g_variant_unref);
+    *static_cast<gint64*>(gwhen) = g_get_monotonic_time();
+}
+
+// time how long it takes the indicator to answer a client's first question,
+// which is also what it takes the bus to activate it if it's not running
+gint64 time_first_call(GDBusConnection* client)
+{
+    gint64 replied_at = 0;
+    const auto called_at = g_get_monotonic_time();
+    g_dbus_connection_call(client, INDICATOR_BUS_NAME, INDICATOR_OBJECT_PATH, "org.gtk.Actions", "DescribeAll",
+                           nullptr, G_VARIANT_TYPE("(a{s(bgav)})"), G_DBUS_CALL_FLAGS_NONE, -1, nullptr,
+                           on_describe_reply, &replied_at);
+    benchmark::run_until([&replied_at]()
+                         {
+                             return replied_at != 0;
+                         });
+    return replied_at != 0 ? replied_at - called_at : -1;
+}
+
+// a session service file that starts the indicator on this bus,
+// exiting again after one idle second
+void write_service_file(const char* service_dir, const char* address, const char* cache_dir, const char* service_path)
+{
+    auto filename = g_build_filename(service_dir, INDICATOR_BUS_NAME ".service", nullptr);
+    auto contents = g_strdup_printf(
+        "[D-BUS Service]\n"
+        "Name=%s\n"
+        "Exec=/usr/bin/env DBUS_SESSION_BUS_ADDRESS=%s DBUS_SYSTEM_BUS_ADDRESS=%s XDG_CACHE_HOME=%s %s --idle-exit=1\n",
+        INDICATOR_BUS_NAME, address, address, cache_dir, service_path);
+    GError* error = nullptr;
+    g_file_set_contents(filename, contents, -1, &error);
+    g_assert_no_error(error);
+    g_free(contents);
+    g_free(filename);
+}
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    GOptionEntry entries[] = {
+        {"iterations", 'n', 0, G_OPTION_ARG_INT, &options.iterations, "Calls to time in each mode (default: 10)", "N"},
+        {"service", 0, 0, G_OPTION_ARG_FILENAME, &options.service_path, "Path to the service executable", "PATH"},
+        {"json", 0, 0, G_OPTION_ARG_FILENAME, &options.json_filename, "Write the results here as JSON", "FILE"},
+        {nullptr}};
+
+    GError* error = nullptr;
+    GOptionContext* context = g_option_context_new(nullptr);
+    g_option_context_add_main_entries(context, entries, nullptr);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+    if (options.service_path == nullptr)
+    {
+        g_printerr("--service is required\n");
+        return 1;
+    }
+
+    auto cache_dir = g_dir_make_tmp("indicator-location-reactivation-XXXXXX", &error);
+    g_assert_no_error(error);
+    auto service_dir = g_build_filename(cache_dir, "services", nullptr);
+    g_mkdir(service_dir, 0700);
+
+    // the bus
+    g_unsetenv("DBUS_SYSTEM_BUS_ADDRESS");
+    auto test_dbus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_add_service_dir(test_dbus, service_dir);
+    g_test_dbus_up(test_dbus);
+    const auto address = g_test_dbus_get_bus_address(test_dbus);
+
+    // the location service
+    std::unique_ptr<LocationServiceMock> location_service(new LocationServiceMock(address));
+    location_service->set_is_online(true);
+    location_service->set_state("active");
+    location_service->own_name();
+
+    // the shell
+    auto flags = GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                      G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION);
+    auto client = g_dbus_connection_new_for_address_sync(address, flags, nullptr, nullptr, &error);
+    g_assert_no_error(error);
+    bool owned = false;
+    auto watch_tag = g_bus_watch_name_on_connection(client, INDICATOR_BUS_NAME, G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                    on_indicator_appeared, on_indicator_vanished, &owned, nullptr);
+    bool ok = true;
+
+    // resident: launch it once and keep asking
+    std::vector<gint64> resident;
+    auto envp = g_get_environ();
+    envp = g_environ_setenv(envp, "DBUS_SESSION_BUS_ADDRESS", address, true);
+    envp = g_environ_setenv(envp, "DBUS_SYSTEM_BUS_ADDRESS", address, true);
+    envp = g_environ_setenv(envp, "XDG_CACHE_HOME", cache_dir, true);
+    gchar* resident_argv[] = {options.service_path, nullptr};
+    GPid pid = 0;
+    g_spawn_async(nullptr, resident_argv, envp, G_SPAWN_DO_NOT_REAP_CHILD, nullptr, nullptr, &pid, &error);
+    g_strfreev(envp);
+    g_assert_no_error(error);
+    ok = benchmark::run_until([&owned]()
+                              {
+                                  return owned;
+                              });
+    for (int i = 0; ok && i < options.iterations; ++i)
+    {
+        const auto usec = time_first_call(client);
+        ok = usec >= 0;
+        resident.push_back(usec);
+    }
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+    g_spawn_close_pid(pid);
+    benchmark::run_until([&owned]()
+                         {
+                             return !owned;
+                         });
+
+    // reactivated: let it exit for being idle, then ask again
+    std::vector<gint64> reactivated;
+    write_service_file(service_dir, address, cache_dir, options.service_path);
+    for (int i = 0; ok && i < options.iterations; ++i)
+    {
+        ok = !owned;
+        if (ok)
+        {
+            const auto usec = time_first_call(client);
+            ok = usec >= 0;
+            reactivated.push_back(usec);
+        }
+        if (ok)
+        {
+            ok = benchmark::run_until([&owned]()
+                                      {
+                                          return !owned;
+                                      });
+        }
+    }
+    if (!ok)
+    {
+        g_printerr("Timed out waiting for the indicator\n");
+    }
+
+    // report
+    const benchmark::Distribution resident_dist(resident);
+    const benchmark::Distribution reactivated_dist(reactivated);
+    resident_dist.print("first call, resident");
+    reactivated_dist.print("first call, reactivated");
+    std::string json = "{\"benchmark\": \"reactivation\"";
+    json += ", \"resident_usec\": " + resident_dist.to_json();
+    json += ", \"reactivated_usec\": " + reactivated_dist.to_json();
+    json += "}";
+    if (!benchmark::write_json(options.json_filename, json))
+    {
+        ok = false;
+    }
+
+    // cleanup
+    g_bus_unwatch_name(watch_tag);
+    g_dbus_connection_close_sync(client, nullptr, nullptr);
+    g_object_unref(client);
+    location_service.reset();
+    g_test_dbus_down(test_dbus);
+    g_object_unref(test_dbus);
+    auto service_file = g_build_filename(service_dir, INDICATOR_BUS_NAME ".service", nullptr);
+    auto state_dir = g_build_filename(cache_dir, "indicator-location", nullptr);
+    auto state_file = g_build_filename(state_dir, "state", nullptr);
+    g_remove(service_file);
+    g_remove(state_file);
+    g_rmdir(state_dir);
+    g_rmdir(service_dir);
+    g_rmdir(cache_dir);
+    g_free(state_file);
+    g_free(state_dir);
+    g_free(service_file);
+    g_free(service_dir);
+    g_free(cache_dir);
+    g_free(options.service_path);
+    g_free(options.json_filename);
+    return ok ? 0 : 1;
+}
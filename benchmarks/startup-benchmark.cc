@@ -0,0 +1,325 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+/**
+ * Launches the real service binary N times, each against a fresh private
+ * bus with a stand-in location service, and reports the distribution of
+ * each startup milestone as the service's Debug interface reports it.
+ *
+ * Also reports the service's resident set size once it's up, since
+ * what it links against costs every session memory as well as time.
+ *
+ * With --budget-ms, exits with an error if the median time to the first
+ * accurate header is over budget, so it can gate changes.
+ */
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gio.h>
+
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <cstring>  // strstr()
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmarks/benchmark-utils.h"
+#include "src/dbus-shared.h"
+#include "src/startup-timeline.h"
+#include "tests/location-service-mock.h"
+
+namespace
+{
+struct Options
+{
+    gint iterations{20};
+    gchar* service_path{nullptr};
+    gboolean warm_cache{false};
+    gint budget_msec{0};
+    gchar* json_filename{nullptr};
+};
+
+struct Results
+{
+    std::array<std::vector<gint64>, StartupTimeline::N_MILESTONES> milestones;
+    std::vector<gint64> spawn_to_name;  // as seen from outside, so it includes exec & linking
+    std::vector<gint64> rss_kb;         // once the first accurate header is out
+};
+
+// VmRSS from /proc/pid/status, or -1 if it can't be read
+gint64 get_rss_kb(GPid pid)
+{
+    gint64 rss_kb = -1;
+    gchar* filename = g_strdup_printf("/proc/%d/status", int(pid));
+    gchar* contents = nullptr;
+    if (g_file_get_contents(filename, &contents, nullptr, nullptr))
+    {
+        const char* line = strstr(contents, "VmRSS:");
+        if (line != nullptr)
+        {
+            rss_kb = g_ascii_strtoll(line + strlen("VmRSS:"), nullptr, 10);
+        }
+        g_free(contents);
+    }
+    g_free(filename);
+    return rss_kb;
+}
+
+struct Shell
+{
+    gint64 appeared_at{0};
+    GDBusMenuModel* menu{nullptr};
+};
+
+// note when the indicator shows up and subscribe to its menu as the shell would;
+// the indicator doesn't publish its state until someone's listening
+void on_indicator_appeared(GDBusConnection* client, const gchar*, const gchar*, gpointer gshell)
+{
+    auto shell = static_cast<Shell*>(gshell);
+    shell->appeared_at = g_get_monotonic_time();
+    shell->menu = g_dbus_menu_model_get(client, INDICATOR_BUS_NAME, INDICATOR_OBJECT_PATH "/phone");
+    g_menu_model_get_n_items(G_MENU_MODEL(shell->menu));
+}
+
+void on_timeline_reply(GObject* source, GAsyncResult* res, gpointer gsetme)
+{
+    auto v = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, nullptr);
+    auto setme = static_cast<GVariant**>(gsetme);
+    g_clear_pointer(setme, g_variant_unref);
+    *setme = v != nullptr ? v : g_variant_ref_sink(g_variant_new("(a{sx})", nullptr));
+}
+
+// keep asking for the service's timeline until it's complete
+GVariant* wait_for_timeline(GDBusConnection* client)
+{
+    const auto last = StartupTimeline::milestone_name(StartupTimeline::FIRST_ACCURATE_HEADER);
+    GVariant* timeline = nullptr;
+    const auto deadline = g_get_monotonic_time() + 10 * G_USEC_PER_SEC;
+
+    while (g_get_monotonic_time() < deadline)
+    {
+        GVariant* reply = nullptr;
+        g_dbus_connection_call(client, INDICATOR_BUS_NAME, INDICATOR_OBJECT_PATH, INDICATOR_BUS_NAME ".Debug",
+                               "GetStartupTimeline", nullptr, G_VARIANT_TYPE("(a{sx})"), G_DBUS_CALL_FLAGS_NONE, -1,
+                               nullptr, on_timeline_reply, &reply);
+        benchmark::run_until([&reply]()
+                             {
+                                 return reply != nullptr;
+                             });
+        g_clear_pointer(&timeline, g_variant_unref);
+        timeline = g_variant_get_child_value(reply, 0);
+        g_variant_unref(reply);
+
+        gint64 usec;
+        if (g_variant_lookup(timeline, last, "x", &usec))
+        {
+            return timeline;
+        }
+
+        benchmark::run_until([]()
+                             {
+                                 return false;
+                             },
+                             20);
+    }
+
+    g_clear_pointer(&timeline, g_variant_unref);
+    return nullptr;
+}
+
+bool run_once(const Options& options, const char* cache_dir, Results& results)
+{
+    // unset so the bus daemon doesn't inherit the last run's address
+    g_unsetenv("DBUS_SYSTEM_BUS_ADDRESS");
+    auto test_dbus = g_test_dbus_new(G_TEST_DBUS_NONE);
+    g_test_dbus_up(test_dbus);
+    const auto address = g_test_dbus_get_bus_address(test_dbus);
+
+    // the location service
+    std::unique_ptr<LocationServiceMock> location_service(new LocationServiceMock(address));
+    location_service->set_is_online(true);
+    location_service->set_state("active");
+    location_service->own_name();
+
+    // the shell
+    GError* error = nullptr;
+    auto flags = GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                      G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION);
+    auto client = g_dbus_connection_new_for_address_sync(address, flags, nullptr, nullptr, &error);
+    g_assert_no_error(error);
+    Shell shell;
+    auto watch_tag = g_bus_watch_name_on_connection(client, INDICATOR_BUS_NAME, G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                    on_indicator_appeared, nullptr, &shell, nullptr);
+
+    // the indicator
+    auto envp = g_get_environ();
+    envp = g_environ_setenv(envp, "DBUS_SESSION_BUS_ADDRESS", address, true);
+    envp = g_environ_setenv(envp, "DBUS_SYSTEM_BUS_ADDRESS", address, true);
+    envp = g_environ_setenv(envp, "XDG_CACHE_HOME", cache_dir, true);
+    gchar* argv[] = {options.service_path, nullptr};
+    GPid pid = 0;
+    const auto spawned_at = g_get_monotonic_time();
+    g_spawn_async(nullptr, argv, envp, G_SPAWN_DO_NOT_REAP_CHILD, nullptr, nullptr, &pid, &error);
+    g_strfreev(envp);
+    bool ok = error == nullptr;
+    if (!ok)
+    {
+        g_printerr("Couldn't launch '%s': %s\n", options.service_path, error->message);
+        g_clear_error(&error);
+    }
+
+    GVariant* timeline = nullptr;
+    if (ok)
+    {
+        timeline = wait_for_timeline(client);
+        ok = timeline != nullptr;
+    }
+    if (ok)
+    {
+        results.spawn_to_name.push_back(shell.appeared_at - spawned_at);
+        results.rss_kb.push_back(get_rss_kb(pid));
+        for (int i = 0; i < StartupTimeline::N_MILESTONES; ++i)
+        {
+            gint64 usec;
+            if (g_variant_lookup(timeline, StartupTimeline::milestone_name(StartupTimeline::Milestone(i)), "x", &usec))
+            {
+                results.milestones[i].push_back(usec);
+            }
+        }
+        g_variant_unref(timeline);
+    }
+
+    // cleanup
+    if (pid != 0)
+    {
+        kill(pid, SIGTERM);
+        waitpid(pid, nullptr, 0);
+        g_spawn_close_pid(pid);
+    }
+    g_bus_unwatch_name(watch_tag);
+    g_clear_object(&shell.menu);
+    g_dbus_connection_close_sync(client, nullptr, nullptr);
+    g_object_unref(client);
+    location_service.reset();
+    g_test_dbus_down(test_dbus);
+    g_object_unref(test_dbus);
+    return ok;
+}
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    GOptionEntry entries[] = {
+        {"iterations", 'n', 0, G_OPTION_ARG_INT, &options.iterations, "Launches to time (default: 20)", "N"},
+        {"service", 0, 0, G_OPTION_ARG_FILENAME, &options.service_path, "Path to the service executable", "PATH"},
+        {"warm-cache", 0, 0, G_OPTION_ARG_NONE, &options.warm_cache, "Keep the state cache between launches", nullptr},
+        {"budget-ms", 0, 0, G_OPTION_ARG_INT, &options.budget_msec,
+         "Fail if the median time to an accurate header is over budget", "MSEC"},
+        {"json", 0, 0, G_OPTION_ARG_FILENAME, &options.json_filename, "Write the results here as JSON", "FILE"},
+        {nullptr}};
+
+    GError* error = nullptr;
+    GOptionContext* context = g_option_context_new(nullptr);
+    g_option_context_add_main_entries(context, entries, nullptr);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+    if (options.service_path == nullptr)
+    {
+        g_printerr("--service is required\n");
+        return 1;
+    }
+
+    auto cache_dir = g_dir_make_tmp("indicator-location-startup-XXXXXX", &error);
+    g_assert_no_error(error);
+    auto state_dir = g_build_filename(cache_dir, "indicator-location", nullptr);
+    auto state_file = g_build_filename(state_dir, "state", nullptr);
+
+    Results results;
+    bool ok = true;
+    for (int i = 0; ok && i < options.iterations; ++i)
+    {
+        if (!options.warm_cache)
+        {
+            g_remove(state_file);
+        }
+        ok = run_once(options, cache_dir, results);
+    }
+    if (!ok)
+    {
+        g_printerr("Timed out waiting for the service's startup timeline\n");
+    }
+
+    // report
+    std::string json = "{\"benchmark\": \"startup\", \"warm_cache\": ";
+    json += options.warm_cache ? "true" : "false";
+    const benchmark::Distribution spawn_to_name(results.spawn_to_name);
+    spawn_to_name.print("spawn -> name owned, as seen by a client");
+    json += ", \"spawn_to_name_usec\": " + spawn_to_name.to_json();
+    const benchmark::Distribution rss(results.rss_kb);
+    g_print("resident set size (KiB, n=%zu): min %" G_GINT64_FORMAT "  p50 %" G_GINT64_FORMAT "  max %" G_GINT64_FORMAT
+            "\n",
+            rss.n, rss.min, rss.p50, rss.max);
+    json += ", \"rss_kb\": " + rss.to_json();
+    json += ", \"milestones_usec\": {";
+    for (int i = 0; i < StartupTimeline::N_MILESTONES; ++i)
+    {
+        const auto name = StartupTimeline::milestone_name(StartupTimeline::Milestone(i));
+        const benchmark::Distribution milestone(results.milestones[i]);
+        milestone.print(name);
+        json += std::string(i ? ", " : "") + "\"" + name + "\": " + milestone.to_json();
+    }
+    json += "}}";
+
+    if (ok && (options.budget_msec > 0))
+    {
+        const benchmark::Distribution header(results.milestones[StartupTimeline::FIRST_ACCURATE_HEADER]);
+        if (header.p50 > gint64(options.budget_msec) * 1000)
+        {
+            g_printerr("Over budget: median time to an accurate header was %.1f ms; the budget is %d ms\n",
+                       header.p50 / 1000.0, options.budget_msec);
+            ok = false;
+        }
+    }
+    if (!benchmark::write_json(options.json_filename, json))
+    {
+        ok = false;
+    }
+
+    // cleanup
+    g_remove(state_file);
+    g_rmdir(state_dir);
+    g_rmdir(cache_dir);
+    g_free(state_file);
+    g_free(state_dir);
+    g_free(cache_dir);
+    g_free(options.service_path);
+    g_free(options.json_filename);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+/**
+ * The in-process cost of one state update: a controller property
+ * changing, through Phone's flush, to the new state being set on the
+ * exported action. No bus is involved, so this is just our own overhead.
+ *
+ * For scale, it also times the by-name action lookups that each
+ * update used to make before Phone kept handles to its actions.
+ */
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "benchmarks/benchmark-utils.h"
+#include "src/metrics.h"
+#include "src/phone.h"
+#include "src/utils.h"  // GObjectDeleter
+#include "tests/controller-mock.h"
+
+namespace
+{
+/// Runs 'batches' batches of 'batch_size' calls to func and returns the nsec per call of each batch
+std::vector<gint64> time_batches(int batches, int batch_size, const std::function<void(int)>& func)
+{
+    std::vector<gint64> samples;
+    for (int i = 0; i < batches; ++i)
+    {
+        const auto start = Metrics::now_nsec();
+        for (int j = 0; j < batch_size; ++j)
+        {
+            func(j);
+        }
+        samples.push_back(gint64(Metrics::now_nsec() - start) / batch_size);
+    }
+    return samples;
+}
+
+void print(const char* name, const benchmark::Distribution& d)
+{
+    g_print("%s (nsec per update): min %" G_GINT64_FORMAT "  p50 %" G_GINT64_FORMAT "  p90 %" G_GINT64_FORMAT
+            "  p99 %" G_GINT64_FORMAT "  max %" G_GINT64_FORMAT "\n",
+            name, d.min, d.p50, d.p90, d.p99, d.max);
+}
+}
+
+int main(int argc, char** argv)
+{
+    gint batches = 200;
+    gint batch_size = 1000;
+    gchar* json_filename = nullptr;
+    GOptionEntry entries[] = {
+        {"batches", 'n', 0, G_OPTION_ARG_INT, &batches, "Number of timed batches (default: 200)", "N"},
+        {"batch-size", 0, 0, G_OPTION_ARG_INT, &batch_size, "Updates in each batch (default: 1000)", "N"},
+        {"json", 0, 0, G_OPTION_ARG_FILENAME, &json_filename, "Write the results here as JSON", "FILE"},
+        {nullptr}};
+
+    GError* error = nullptr;
+    GOptionContext* context = g_option_context_new(nullptr);
+    g_option_context_add_main_entries(context, entries, nullptr);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+    batch_size = MAX(batch_size, 1);
+
+    auto controller = std::make_shared<MockController>();
+    std::shared_ptr<GSimpleActionGroup> action_group(g_simple_action_group_new(), GObjectDeleter());
+    std::unique_ptr<Phone> phone(new Phone(controller, action_group));
+    phone->refresh();
+
+    // a GPS switch flip, published right away instead of waiting for the idle pass
+    auto update = [&controller, &phone](int j)
+    {
+        controller->set_gps_enabled(j % 2);
+        phone->refresh();
+    };
+    const benchmark::Distribution updates(time_batches(batches, batch_size, update));
+    print("update", updates);
+
+    // what finding the updated actions by name would have added
+    const auto map = G_ACTION_MAP(action_group.get());
+    const std::array<const char*, 3> keys = {"phone-header", "location-detection-enabled", "gps-detection-enabled"};
+    auto lookups = [map, &keys](int)
+    {
+        for (const auto& key : keys)
+        {
+            g_action_map_lookup_action(map, key);
+        }
+    };
+    const benchmark::Distribution lookup(time_batches(batches, batch_size, lookups));
+    print("lookups", lookup);
+
+    // report
+    gchar* str = g_strdup_printf("{\"benchmark\": \"update\", \"batches\": %d, \"batch_size\": %d, "
+                                 "\"update_nsec\": %s, \"lookup_nsec\": %s}",
+                                 batches, batch_size, updates.to_json().c_str(), lookup.to_json().c_str());
+    const bool ok = benchmark::write_json(json_filename, str);
+    g_free(str);
+
+    // cleanup
+    phone.reset();
+    action_group.reset();
+    controller.reset();
+    g_free(json_filename);
+    return ok ? 0 : 1;
+}
@@ -22,6 +22,7 @@ xgettext \
     --c++ \
     --add-comments=TRANSLATORS \
     --keyword=_ \
+    --keyword=N_ \
     --package-name="$PKGNAME" \
     --copyright-holder="Canonical Ltd."
 
@@ -22,3 +22,27 @@
 Controller::Controller() = default;
 
 Controller::~Controller() = default;
+
+Controller::Snapshot Controller::snapshot() const
+{
+    Snapshot snapshot;
+    snapshot.gps_enabled = gps_enabled().get();
+    snapshot.location_service_enabled = location_service_enabled().get();
+    snapshot.location_service_active = location_service_active().get();
+    return snapshot;
+}
+
+void Controller::request_activation()
+{
+}
+
+bool Controller::is_busy() const
+{
+    return false;
+}
+
+const core::Property<bool>& Controller::is_seeded() const
+{
+    static const core::Property<bool> never{false};
+    return never;
+}
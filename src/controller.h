@@ -20,6 +20,7 @@
 #pragma once
 
 #include <core/property.h>
+#include <core/signal.h>
 
 class Controller
 {
@@ -36,4 +37,33 @@ public:
 
     virtual void set_gps_enabled(bool enabled) = 0;
     virtual void set_location_service_enabled(bool enabled) = 0;
+
+    enum class Setting
+    {
+        GPS_ENABLED,
+        LOCATION_SERVICE_ENABLED
+    };
+
+    /// The backend's values, copied
+    struct Snapshot
+    {
+        bool gps_enabled{false};
+        bool location_service_enabled{false};
+        bool location_service_active{false};
+    };
+    Snapshot snapshot() const;
+
+    /// Emitted when a set_*() request couldn't be applied
+    virtual const core::Signal<Setting>& set_failed() const = 0;
+
+    /// Someone wants to see real values, e.g. a menu has been opened.
+    /// Controllers that defer connecting to their backend connect now.
+    virtual void request_activation();
+
+    /// True if there are requests to the backend that haven't finished
+    virtual bool is_busy() const;
+
+    /// True while is_valid() only because of cached values that the
+    /// backend hasn't confirmed yet
+    virtual const core::Property<bool>& is_seeded() const;
 };
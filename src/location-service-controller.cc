@@ -17,19 +17,56 @@
  *   Charles Kerr <charles.kerr@canonical.com>
  */
 
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
 #include <glib.h>
 
 #include "location-service-controller.h"
+#include "metrics.h"
+#include "remote-property.h"
+#include "snapshot-handoff.h"
+#include "startup-timeline.h"
+#include "tracepoints.h"
 #include "utils.h"
+#include "wakeup-audit.h"
 
 /***
 ****
 ***/
 
+/**
+ * All of the system bus I/O happens on a worker thread with its own
+ * GMainContext, so a slow or chatty location service can't hold up the
+ * main loop that serves the shell.
+ *
+ * Each time the mirrored state changes, the worker publishes an immutable
+ * snapshot of it. The main thread picks the snapshots up in order and
+ * applies them to the properties that it exposes, so its listeners see
+ * the same transitions that they would if everything ran on one thread.
+ * The handoff is a lock-free ring (see SnapshotHandoff), so neither thread
+ * ever waits for the other and the steady state doesn't allocate.
+ *
+ * Members are used by the worker unless their comments say otherwise.
+ */
 class LocationServiceController::Impl
 {
 public:
-    Impl()
+    Impl(bool lazy, const Controller::Snapshot* seed)
+        : m_lazy(lazy)
+        , m_main_context(g_main_context_ref_thread_default())
+        , m_context(g_main_context_new())
+        , m_loop(g_main_loop_new(m_context, false))
+        , m_owner(std::make_shared<Impl*>(this))
+        , m_handoff(new Handoff(m_context, m_main_context, [this](const StateSnapshot& snapshot)
+                                {
+                                    apply(snapshot);
+                                }))
     {
         m_cancellable.reset(g_cancellable_new(), [](GCancellable* c)
                             {
@@ -37,61 +74,389 @@ public:
                                 g_object_unref(c);
                             });
 
-        g_bus_get(G_BUS_TYPE_SYSTEM, m_cancellable.get(), on_system_bus_ready, this);
+        // note each change so that it's published when the worker's done with it
+        auto on_changed = [this](bool)
+        {
+            m_dirty = true;
+        };
+        for (auto& property : m_remote_properties)
+        {
+            m_connections.push_back(property.value->changed().connect(on_changed));
+        }
+        m_connections.push_back(m_is_valid.changed().connect(on_changed));
+        m_connections.push_back(m_is_seeded.changed().connect(on_changed));
+
+        // before the worker starts, so that it never sees the unseeded state
+        if (seed != nullptr)
+        {
+            apply_seed(*seed);
+        }
+
+        WakeupAudit::watch_system_bus_context(m_context);
+        m_thread = std::thread(&Impl::run_worker, this);
     }
 
-    ~Impl() = default;
+    ~Impl()
+    {
+        // wind the worker down on its own thread
+        *m_owner = nullptr;
+        post_to_worker([](Impl* self)
+                       {
+                           self->shutdown();
+                       });
+        m_thread.join();
+
+        m_handoff.reset();  // its sources are attached to the contexts
+        g_main_loop_unref(m_loop);
+        g_main_context_unref(m_context);
+        g_main_context_unref(m_main_context);
+    }
+
+    /***
+    ****  Called from the main thread
+    ***/
 
     const core::Property<bool>& is_valid() const
     {
-        return m_is_valid;
+        return m_main.is_valid;
     }
 
     const core::Property<bool>& gps_enabled() const
     {
-        return m_gps_enabled;
+        return m_main.values[PROP_GPS_ENABLED];
     }
 
     const core::Property<bool>& location_service_enabled() const
     {
-        return m_loc_enabled;
+        return m_main.values[PROP_LOC_ENABLED];
     }
 
     const core::Property<bool>& location_service_active() const
     {
-        return m_loc_active;
+        return m_main.values[PROP_LOC_STATE];
+    }
+
+    const core::Property<bool>& is_seeded() const
+    {
+        return m_main.is_seeded;
     }
 
     void set_gps_enabled(bool enabled)
     {
-        set_bool_property(PROP_KEY_GPS_ENABLED, enabled);
+        post_to_worker([enabled](Impl* self)
+                       {
+                           self->set_bool_property(PROP_GPS_ENABLED, enabled);
+                       });
     }
 
     void set_location_service_enabled(bool enabled)
     {
-        set_bool_property(PROP_KEY_LOC_ENABLED, enabled);
+        post_to_worker([enabled](Impl* self)
+                       {
+                           self->set_bool_property(PROP_LOC_ENABLED, enabled);
+                       });
+    }
+
+    const core::Signal<Controller::Setting>& set_failed() const
+    {
+        return m_set_failed;
+    }
+
+    LocationServiceController::Stats stats() const
+    {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        return m_stats;
+    }
+
+    bool is_busy() const
+    {
+        return (m_calls_in_flight > 0) || (m_requests_in_transit > 0) || (m_sets_held > 0) ||
+               !m_handoff->is_empty();
+    }
+
+    void set_outage_grace_msec(unsigned int msec)
+    {
+        post_to_worker([msec](Impl* self)
+                       {
+                           self->m_outage_grace_msec = msec;
+                       });
+    }
+
+    void request_activation()
+    {
+        post_to_worker([](Impl* self)
+                       {
+                           self->activate();
+                       });
     }
 
 private:
+    // the location-service properties that we mirror; see m_remote_properties
+    enum PropertyIndex
+    {
+        PROP_LOC_ENABLED,
+        PROP_GPS_ENABLED,
+        PROP_LOC_STATE,
+        N_PROPS
+    };
+
+    // user_data for async calls that need to get back to the Impl.
+    // Holds its own ref to m_cancellable so that the callback can tell
+    // whether the worker was shut down while the call was in flight.
+    struct CallData
+    {
+        explicit CallData(Impl* self_)
+            : self(self_)
+            , cancellable(G_CANCELLABLE(g_object_ref(self_->m_cancellable.get())))
+        {
+            ++self->m_calls_in_flight;
+        }
+
+        virtual ~CallData()
+        {
+            --self->m_calls_in_flight;
+            g_object_unref(cancellable);
+        }
+
+        // if true, we're shutting down and the reply should be ignored
+        bool is_cancelled() const
+        {
+            return g_cancellable_is_cancelled(cancellable);
+        }
+
+        Impl* const self;
+        GCancellable* const cancellable;
+    };
+
+    /***
+    ****  The worker thread
+    ***/
+
+    void run_worker()
+    {
+        // async calls and signal subscriptions made from here are dispatched here
+        g_main_context_push_thread_default(m_context);
+
+        g_bus_get(G_BUS_TYPE_SYSTEM, m_cancellable.get(), on_system_bus_ready, new CallData(this));
+        g_main_loop_run(m_loop);
+
+        // let the calls that shutdown() cancelled finish before we go
+        while (m_calls_in_flight > 0)
+        {
+            g_main_context_iteration(m_context, true);
+        }
+
+        g_main_context_pop_thread_default(m_context);
+    }
+
+    void shutdown()
+    {
+        remove_timeout(m_attach_tag);
+        remove_timeout(m_invalidate_tag);
+        m_signal_tag.reset();
+        m_name_tag.reset();
+        m_cancellable.reset();  // cancels everything in flight
+        g_main_loop_quit(m_loop);
+    }
+
+    // Runs 'func' once from 'context'. Unlike g_main_context_invoke(),
+    // this never runs it right away, even if we're already on that thread.
+    static void post(GMainContext* context, std::function<void()>&& func)
+    {
+        auto source = g_idle_source_new();
+        g_source_set_priority(source, G_PRIORITY_DEFAULT);
+        g_source_set_callback(source,
+                              [](gpointer gfunc)
+                              {
+                                  (*static_cast<std::function<void()>*>(gfunc))();
+                                  return G_SOURCE_REMOVE;
+                              },
+                              new std::function<void()>(std::move(func)),
+                              [](gpointer gfunc)
+                              {
+                                  delete static_cast<std::function<void()>*>(gfunc);
+                              });
+        g_source_attach(source, context);
+        g_source_unref(source);
+    }
+
+    // called from the main thread
+    void post_to_worker(std::function<void(Impl*)>&& func)
+    {
+        ++m_requests_in_transit;
+        auto self = this;
+        post(m_context, [self, func]()
+             {
+                 --self->m_requests_in_transit;
+                 func(self);
+             });
+    }
+
+    // g_timeout_add() would put it on the main thread's context
+    guint add_timeout(guint msec, GSourceFunc func)
+    {
+        auto source = g_timeout_source_new(msec);
+        g_source_set_callback(source, func, this, nullptr);
+        const auto tag = g_source_attach(source, m_context);
+        g_source_unref(source);
+        return tag;
+    }
+
+    // returns true if there was one to remove
+    bool remove_timeout(guint& tag)
+    {
+        if (tag == 0)
+        {
+            return false;
+        }
+
+        g_source_destroy(g_main_context_find_source_by_id(m_context, tag));
+        tag = 0;
+        return true;
+    }
+
+    void count(unsigned int LocationServiceController::Stats::*field)
+    {
+        std::lock_guard<std::mutex> lock(m_stats_mutex);
+        ++(m_stats.*field);
+    }
+
+    // called from the constructor, so both threads' state can be set
+    void apply_seed(const Controller::Snapshot& snapshot)
+    {
+        g_debug("seeding with loc %d gps %d active %d", int(snapshot.location_service_enabled),
+                int(snapshot.gps_enabled), int(snapshot.location_service_active));
+
+        m_loc_enabled.set(snapshot.location_service_enabled);
+        m_gps_enabled.set(snapshot.gps_enabled);
+        m_loc_active.set(snapshot.location_service_active);
+        m_is_valid.set(true);
+        m_is_seeded.set(true);
+
+        m_main.values[PROP_LOC_ENABLED].set(snapshot.location_service_enabled);
+        m_main.values[PROP_GPS_ENABLED].set(snapshot.gps_enabled);
+        m_main.values[PROP_LOC_STATE].set(snapshot.location_service_active);
+        m_main.is_valid.set(true);
+        m_main.is_seeded.set(true);
+    }
+
+    void activate()
+    {
+        if (!m_lazy || m_activation_requested || m_service_present)
+        {
+            return;
+        }
+
+        m_activation_requested = true;
+
+        // if the bus isn't ready yet, on_system_bus_ready() will do it
+        if (m_system_bus)
+        {
+            start_service();
+        }
+    }
+
+    /***
+    ****  Handing state over to the main thread
+    ****
+    ****  The worker publishes once it's finished handling an event rather
+    ****  than once per property, so the main thread never sees a half-applied
+    ****  bootstrap. It publishes every change though, not just the latest:
+    ****  listeners on the main thread expect to see each transition, so
+    ****  they're only coalesced if the main thread falls far behind.
+    ***/
+
+    struct StateSnapshot
+    {
+        bool is_valid;
+        bool is_seeded;
+        std::array<bool, N_PROPS> values;  // by PropertyIndex
+        guint64 published_at;              // Metrics::now_nsec()
+    };
+
+    // Enough to ride out a busy main loop; past that the handoff coalesces
+    // snapshots rather than allocating, so listeners may skip transitions
+    // but always end up with the latest state.
+    typedef SnapshotHandoff<StateSnapshot, 64> Handoff;
+
+    void publish()
+    {
+        if (!m_dirty)
+        {
+            return;
+        }
+
+        m_dirty = false;
+        StateSnapshot snapshot;
+        snapshot.is_valid = m_is_valid.get();
+        snapshot.is_seeded = m_is_seeded.get();
+        for (int i = 0; i < N_PROPS; ++i)
+        {
+            snapshot.values[i] = m_remote_properties[i].value->get();
+        }
+        snapshot.published_at = Metrics::now_nsec();
+        m_handoff->push(snapshot);
+    }
+
+    // called from the main thread
+    void apply(const StateSnapshot& snapshot)
+    {
+        WakeupAudit::attribute(WakeupAudit::SOURCE_CONTROLLER);
+
+        auto& metrics = Metrics::get();
+        const guint64 start = Metrics::now_nsec();
+        metrics.record(Metrics::STAGE_THREAD_HANDOFF, start - snapshot.published_at);
+
+        for (int i = 0; i < N_PROPS; ++i)
+        {
+            m_main.values[i].set(snapshot.values[i]);
+        }
+        m_main.is_valid.set(snapshot.is_valid);
+        m_main.is_seeded.set(snapshot.is_seeded);
+
+        metrics.record(Metrics::STAGE_PROPERTY_FANOUT, Metrics::now_nsec() - start);
+    }
+
+    void report_set_failure(PropertyIndex prop)
+    {
+        auto owner = m_owner;
+        const auto setting = setting_for_property(prop);
+        post(m_main_context, [owner, setting]()
+             {
+                 if (*owner != nullptr)
+                 {
+                     (*owner)->m_set_failed(setting);
+                 }
+             });
+    }
+
     /***
     ****  bus bootstrapping & name watching
     ***/
 
-    static void on_system_bus_ready(GObject*, GAsyncResult* res, gpointer gself)
+    static void on_system_bus_ready(GObject*, GAsyncResult* res, gpointer gcall)
     {
+        auto call = static_cast<CallData*>(gcall);
         GError* error;
         GDBusConnection* system_bus;
 
         error = nullptr;
         system_bus = g_bus_get_finish(res, &error);
-        if (system_bus != nullptr)
+        if ((system_bus != nullptr) && call->is_cancelled())
         {
-            auto self = static_cast<Impl*>(gself);
+            g_object_unref(system_bus);
+        }
+        else if (system_bus != nullptr)
+        {
+            auto self = call->self;
 
+            StartupTimeline::get().mark(StartupTimeline::SYSTEM_BUS_READY);
             self->m_system_bus.reset(system_bus, GObjectDeleter());
 
-            auto name_tag = g_bus_watch_name_on_connection(system_bus, BUS_NAME, G_BUS_NAME_WATCHER_FLAGS_AUTO_START,
-                                                           on_name_appeared, on_name_vanished, gself, nullptr);
+            // in lazy mode, only attach if it's already running
+            const auto flags = self->m_lazy ? G_BUS_NAME_WATCHER_FLAGS_NONE : G_BUS_NAME_WATCHER_FLAGS_AUTO_START;
+            auto name_tag = g_bus_watch_name_on_connection(system_bus, BUS_NAME, flags, on_name_appeared,
+                                                           on_name_vanished, self, nullptr);
 
             //  manage the name_tag's lifespan
             self->m_name_tag.reset(new guint{name_tag}, [](guint* tag)
@@ -99,72 +464,209 @@ private:
                                        g_bus_unwatch_name(*tag);
                                        delete tag;
                                    });
+
+            if (self->m_activation_requested)
+            {
+                self->start_service();
+            }
+
+            self->send_held_sets();
         }
         else if (error != nullptr)
         {
             if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
             {
                 g_warning("Couldn't get system bus: %s", error->message);
+                call->self->fail_held_sets();
             }
             g_error_free(error);
         }
+
+        delete call;
     }
 
-    static void on_name_appeared(GDBusConnection* system_bus,
+    static void on_name_appeared(GDBusConnection* /*system_bus*/,
                                  const gchar* /*bus_name*/,
                                  const gchar* name_owner,
                                  gpointer gself)
     {
         auto self = static_cast<Impl*>(gself);
+        ++self->m_appearance;
+        self->m_service_present = true;
+        self->m_appeared_at = g_get_monotonic_time();
+        self->m_name_owner = name_owner;
+        StartupTimeline::get().mark(StartupTimeline::SERVICE_APPEARED);
+        TRACE1(name_appeared, self->m_appearance);
+
+        // if it's been crash-looping, give it a moment to prove it's
+        // staying before we subscribe & bootstrap again
+        const auto delay_msec = self->backoff_msec();
+        if (delay_msec == 0)
+        {
+            self->attach();
+        }
+        else
+        {
+            g_debug("location-service has flapped %u times; waiting %u ms to bootstrap", self->m_flaps, delay_msec);
+            self->count(&Stats::backoffs);
+            Metrics::get().increment(Metrics::COUNTER_BACKOFFS);
+            self->m_attach_tag = self->add_timeout(delay_msec, on_attach_timeout);
+        }
+    }
+
+    static gboolean on_attach_timeout(gpointer gself)
+    {
+        auto self = static_cast<Impl*>(gself);
+        self->m_attach_tag = 0;
+        self->attach();
+        return G_SOURCE_REMOVE;
+    }
+
+    void attach()
+    {
+        auto system_bus = m_system_bus.get();
 
         // Why do we use PropertiesChanged, Get, and Set by hand instead
         // of letting gdbus-codegen or g_dbus_proxy_new() do the dirty work?
-        // ubuntu-location-service's GetAll method is broken; proxies aren't
-        // able to bootstrap themselves and cache the object properties. Ugh.
+        // ubuntu-location-service's GetAll method has been broken; proxies
+        // aren't able to bootstrap themselves and cache the object properties.
 
-        // subscribe to PropertiesChanged signals from the service
+        // subscribe to PropertiesChanged signals from the service;
+        // filtering on arg0 keeps changes to its other interfaces from waking us
         auto signal_tag = g_dbus_connection_signal_subscribe(
-            system_bus, name_owner, PROP_IFACE_NAME, "PropertiesChanged", OBJECT_PATH,
-            nullptr,  // arg0
-            G_DBUS_SIGNAL_FLAGS_NONE, on_properties_changed, gself, nullptr);
+            system_bus, m_name_owner.c_str(), PROP_IFACE_NAME, "PropertiesChanged", OBJECT_PATH,
+            LOC_IFACE_NAME,  // arg0
+            G_DBUS_SIGNAL_FLAGS_NONE, on_properties_changed, this, nullptr);
 
         // manage the signal_tag lifespan
         g_object_ref(system_bus);
-        self->m_signal_tag.reset(new guint{signal_tag}, [system_bus](guint* tag)
-                                 {
-                                     g_dbus_connection_signal_unsubscribe(system_bus, *tag);
-                                     g_object_unref(system_bus);
-                                     delete tag;
-                                 });
-
-        // GetAll is borked so call Get on each property we care about
-        struct
-        {
-            const char* name;
-            GAsyncReadyCallback callback;
-        } props[] = {{PROP_KEY_LOC_ENABLED, on_loc_enabled_reply}, {PROP_KEY_GPS_ENABLED, on_gps_enabled_reply},
-                     {PROP_KEY_LOC_STATE, on_loc_state_reply}};
-        for (const auto& prop : props)
+        m_signal_tag.reset(new guint{signal_tag}, [system_bus](guint* tag)
+                           {
+                               g_dbus_connection_signal_unsubscribe(system_bus, *tag);
+                               g_object_unref(system_bus);
+                               delete tag;
+                           });
+
+        // fetch the initial state; is_valid flips when it's all arrived
+        start_bootstrap(system_bus);
+    }
+
+    static void on_name_vanished(GDBusConnection*, const gchar*, gpointer gself)
+    {
+        auto self = static_cast<Impl*>(gself);
+
+        // in lazy mode, not running yet isn't the same as going away;
+        // keep showing what we were seeded with until it's needed
+        if (self->m_lazy && !self->m_service_present)
         {
-            g_dbus_connection_call(system_bus, BUS_NAME, OBJECT_PATH, PROP_IFACE_NAME, "Get",
-                                   g_variant_new("(ss)", LOC_IFACE_NAME, prop.name),  // args
-                                   G_VARIANT_TYPE("(v)"),                             // return type
-                                   G_DBUS_CALL_FLAGS_NONE,
-                                   -1,  // use default timeout
-                                   self->m_cancellable.get(), prop.callback, gself);
+            g_debug("location-service isn't running");
+            return;
         }
 
-        g_debug("setting is_valid to true: location-service appeared");
-        self->m_is_valid.set(true);
+        ++self->m_appearance;  // orphan any bootstrap in flight
+        self->m_service_present = false;
+        self->m_activation_requested = false;  // the next request should start it again
+        TRACE1(name_vanished, self->m_appearance);
+        self->m_signal_tag.reset();
+
+        // a service that goes away soon after appearing is flapping
+        const auto uptime_usec = g_get_monotonic_time() - self->m_appeared_at;
+        if ((self->m_appeared_at != 0) && (uptime_usec < gint64(FLAP_WINDOW_MSEC) * 1000))
+        {
+            ++self->m_flaps;
+        }
+        else
+        {
+            self->m_flaps = 0;
+        }
+
+        if (self->remove_timeout(self->m_attach_tag))
+        {
+            self->count(&Stats::cycles_suppressed);
+            Metrics::get().increment(Metrics::COUNTER_CYCLES_SUPPRESSED);
+        }
+
+        // don't let a short outage reach the UI
+        if (!self->m_is_valid.get() || (self->m_invalidate_tag != 0))
+        {
+            return;
+        }
+        if (self->m_outage_grace_msec == 0)
+        {
+            self->invalidate();
+        }
+        else
+        {
+            self->m_invalidate_tag = self->add_timeout(self->m_outage_grace_msec, on_invalidate_timeout);
+        }
     }
 
-    static void on_name_vanished(GDBusConnection*, const gchar*, gpointer gself)
+    static gboolean on_invalidate_timeout(gpointer gself)
     {
         auto self = static_cast<Impl*>(gself);
+        self->m_invalidate_tag = 0;
+        self->invalidate();
+        return G_SOURCE_REMOVE;
+    }
 
+    void invalidate()
+    {
         g_debug("setting is_valid to false: location-service vanished");
-        self->m_is_valid.set(false);
-        self->m_signal_tag.reset();
+        m_is_valid.set(false);
+        m_is_seeded.set(false);
+        publish();
+    }
+
+    /***
+    ****  Flap protection
+    ****
+    ****  If the location service is crash-looping, every appearance would
+    ****  cost a resubscribe and a bootstrap, and every vanishing would
+    ****  disable both switches and rebuild the header. Instead we wait
+    ****  longer each time before bootstrapping a service that keeps
+    ****  going away, and keep showing the old state through short outages.
+    ***/
+
+    unsigned int backoff_msec() const
+    {
+        if (m_flaps == 0)
+        {
+            return 0;
+        }
+
+        const guint shift = MIN(m_flaps - 1, 16u);
+        return MIN(BACKOFF_BASE_MSEC << shift, BACKOFF_MAX_MSEC);
+    }
+
+    /***
+    ****  On-demand activation
+    ***/
+
+    void start_service()
+    {
+        g_debug("asking the bus to start the location service");
+
+        // once it's up, our name watch takes it from there
+        g_dbus_connection_call(m_system_bus.get(), "org.freedesktop.DBus", "/org/freedesktop/DBus",
+                               "org.freedesktop.DBus", "StartServiceByName",
+                               g_variant_new("(su)", BUS_NAME, 0u),  // args
+                               G_VARIANT_TYPE("(u)"),                // return type
+                               G_DBUS_CALL_FLAGS_NONE,
+                               -1,  // use default timeout
+                               m_cancellable.get(), on_start_service_reply, new CallData(this));
+    }
+
+    static void on_start_service_reply(GObject* connection, GAsyncResult* res, gpointer gcall)
+    {
+        auto call = static_cast<CallData*>(gcall);
+        const bool success = check_method_call_reply(connection, res);
+
+        if (!success && !call->is_cancelled())
+        {
+            call->self->m_activation_requested = false;  // let the next request retry
+        }
+
+        delete call;
     }
 
     /***
@@ -180,60 +682,158 @@ private:
                                       gpointer gself)
     {
         auto self = static_cast<Impl*>(gself);
+        const guint64 start = Metrics::now_nsec();
         const gchar* interface_name;
         GVariant* changed_properties;
-        const gchar** invalidated_properties;
+        GVariant* invalidated_properties;
         GVariantIter property_iter;
         const gchar* key;
         GVariant* val;
 
-        g_variant_get(parameters, "(&s@a{sv}^a&s)", &interface_name, &changed_properties, &invalidated_properties);
+        g_variant_get(parameters, "(&s@a{sv}@as)", &interface_name, &changed_properties, &invalidated_properties);
+
+        // the match rule should have taken care of this, but make sure
+        if (g_strcmp0(interface_name, LOC_IFACE_NAME))
+        {
+            g_variant_unref(changed_properties);
+            g_variant_unref(invalidated_properties);
+            return;
+        }
 
         g_variant_iter_init(&property_iter, changed_properties);
         while (g_variant_iter_next(&property_iter, "{&sv}", &key, &val))
         {
-            if (!g_strcmp0(key, PROP_KEY_LOC_ENABLED))
-            {
-                self->m_loc_enabled.set(g_variant_get_boolean(val));
-            }
-            else if (!g_strcmp0(key, PROP_KEY_GPS_ENABLED))
-            {
-                self->m_gps_enabled.set(g_variant_get_boolean(val));
-            }
-            else if (!g_strcmp0(key, PROP_KEY_LOC_STATE))
+            TRACE2(property_changed, key, g_variant_get_type_string(val));
+
+            const auto prop = self->property_for_key(key);
+            if (prop != N_PROPS)
             {
-                auto state_str = std::string(g_variant_get_string(val, nullptr));
-                self->m_loc_active.set(state_str == "active");
+                ++self->m_generation[prop];
+                auto& property = self->remote_property(prop);
+                if (property.update(val))
+                {
+                    TRACE2(property_updated, key, property.as_int());
+                }
+                else
+                {
+                    TRACE2(property_updated, key, -1);
+                }
             }
 
             g_variant_unref(val);
         }
 
+        // these changed without telling us the new values, so ask.
+        // (iterated in place; ^a&s would allocate a strv even when it's empty)
+        g_variant_iter_init(&property_iter, invalidated_properties);
+        while (g_variant_iter_next(&property_iter, "&s", &key))
+        {
+            const auto prop = self->property_for_key(key);
+            if (prop != N_PROPS)
+            {
+                self->refresh_property(prop);
+            }
+        }
+
         g_variant_unref(changed_properties);
-        g_free(invalidated_properties);
+        g_variant_unref(invalidated_properties);
+
+        // the listeners are on the main thread, so this is all decoding
+        self->publish();
+        Metrics::get().record(Metrics::STAGE_SIGNAL_DECODE, Metrics::now_nsec() - start);
+    }
+
+    /***
+    ****  Invalidated properties
+    ****
+    ****  A property listed in PropertiesChanged's invalidated_properties
+    ****  has a new value that wasn't sent, so we Get just that property.
+    ***/
+
+    struct RefreshCall : public CallData
+    {
+        RefreshCall(Impl* self_, PropertyIndex prop_)
+            : CallData(self_)
+            , prop(prop_)
+            , appearance(self_->m_appearance)
+            , generation(self_->m_generation[prop_])
+        {
+        }
+
+        const PropertyIndex prop;
+        const unsigned int appearance;
+        const unsigned int generation;  // the property's generation when the call went out
+    };
+
+    void refresh_property(PropertyIndex prop)
+    {
+        count(&Stats::invalidations);
+
+        // any value already on its way to us is out of date now
+        ++m_generation[prop];
+
+        const auto key = key_for_property(prop);
+        TRACE1(get_issued, key);
+        g_dbus_connection_call(m_system_bus.get(), BUS_NAME, OBJECT_PATH, PROP_IFACE_NAME, "Get",
+                               g_variant_new("(ss)", LOC_IFACE_NAME, key),  // args
+                               G_VARIANT_TYPE("(v)"),                       // return type
+                               G_DBUS_CALL_FLAGS_NONE,
+                               -1,  // use default timeout
+                               m_cancellable.get(), on_refresh_reply, new RefreshCall(this, prop));
+    }
+
+    static void on_refresh_reply(GObject* source_object, GAsyncResult* res, gpointer gcall)
+    {
+        auto call = static_cast<RefreshCall*>(gcall);
+        GVariant* value = get_reply_from_call(source_object, res);
+        TRACE2(get_reply, call->self->key_for_property(call->prop), int(value != nullptr));
+
+        if ((value != nullptr) && !call->is_cancelled())
+        {
+            call->self->on_refresh_done(*call, value);
+        }
+
+        if (value != nullptr)
+        {
+            g_variant_unref(value);
+        }
+        delete call;
+    }
+
+    void on_refresh_done(const RefreshCall& call, GVariant* value)
+    {
+        if (call.appearance != m_appearance)
+        {
+            g_debug("discarding refresh: location-service vanished while it was in flight");
+        }
+        else if (call.generation != m_generation[call.prop])
+        {
+            g_debug("dropping stale refresh for property #%d", int(call.prop));
+            count(&Stats::stale_replies_dropped);
+        }
+        else
+        {
+            remote_property(call.prop).update(value);
+            publish();
+        }
     }
 
     /***
     ****  org.freedesktop.dbus.properties.Get handling
     ***/
 
-    static std::tuple<bool, bool> get_bool_reply_from_call(GObject* source, GAsyncResult* res)
+    // returns the reply's value, or nullptr if the call failed
+    static GVariant* get_reply_from_call(GObject* source, GAsyncResult* res)
     {
         GError* error;
         GVariant* v;
-        bool success{false};
-        bool result{false};
+        GVariant* value{};
 
         error = nullptr;
-        GDBusConnection* conn = G_DBUS_CONNECTION(source);
-        v = g_dbus_connection_call_finish(conn, res, &error);
+        v = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
         if (v != nullptr)
         {
-            GVariant* inner{};
-            g_variant_get(v, "(v)", &inner);
-            success = true;
-            result = g_variant_get_boolean(inner);
-            g_variant_unref(inner);
+            g_variant_get(v, "(v)", &value);
             g_variant_unref(v);
         }
         else if (error != nullptr)
@@ -243,97 +843,420 @@ private:
                 g_warning("Error calling dbus method: %s", error->message);
             }
             g_error_free(error);
-            success = false;
         }
 
-        return std::make_tuple(success, result);
+        return value;
+    }
+
+    static void on_bootstrap_get_reply(GObject* source_object, GAsyncResult* res, gpointer gget)
+    {
+        auto get = static_cast<Bootstrap::Get*>(gget);
+        const auto key = get->bootstrap->self->key_for_property(get->prop);
+        GVariant* value = get_reply_from_call(source_object, res);
+        TRACE2(get_reply, key, int(value != nullptr));
+        g_debug("service %s reply: success %d", key, int(value != nullptr));
+        get->bootstrap->set_value(get->prop, value);
+        on_bootstrap_get_done(get->bootstrap);
+    }
+
+    /***
+    ****  Bootstrapping
+    ****
+    ****  When the service appears we fetch everything we mirror, then apply
+    ****  it all at once and flip is_valid so that clients see one transition
+    ****  instead of stale defaults followed by a correction per property.
+    ***/
+
+    struct Bootstrap : public CallData
+    {
+        explicit Bootstrap(Impl* self_)
+            : CallData(self_)
+            , appearance(self_->m_appearance)
+            , start_time(g_get_monotonic_time())
+            , generation(self_->m_generation)
+        {
+            for (int i = 0; i < N_PROPS; ++i)
+            {
+                gets[i] = {this, PropertyIndex(i)};
+            }
+        }
+
+        ~Bootstrap()
+        {
+            for (auto& value : values)
+            {
+                g_clear_pointer(&value, g_variant_unref);
+            }
+        }
+
+        // takes ownership of 'value'
+        void set_value(PropertyIndex prop, GVariant* value)
+        {
+            g_clear_pointer(&values[prop], g_variant_unref);
+            values[prop] = value;
+        }
+
+        bool have_all_values() const
+        {
+            for (const auto& value : values)
+            {
+                if (value == nullptr)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        // user_data for the fallback Gets
+        struct Get
+        {
+            Bootstrap* bootstrap;
+            PropertyIndex prop;
+        };
+
+        const unsigned int appearance;
+        const gint64 start_time;
+        std::array<unsigned int, N_PROPS> generation;  // property generations when the calls went out
+        const char* method{"GetAll"};
+        int n_pending{0};
+        std::array<Get, N_PROPS> gets;
+        std::array<GVariant*, N_PROPS> values{};  // the service's values, or nullptr if we don't have one yet
+    };
+
+    void start_bootstrap(GDBusConnection* system_bus)
+    {
+        auto bootstrap = new Bootstrap(this);
+
+        // ubuntu-location-service's GetAll has been broken in the past,
+        // so fall back to individual Gets if it doesn't give us everything.
+        // A broken one may hang rather than fail, so don't wait long for it:
+        // is_valid, and so the whole indicator, is waiting on this.
+        TRACE1(get_issued, "*");
+        g_dbus_connection_call(system_bus, BUS_NAME, OBJECT_PATH, PROP_IFACE_NAME, "GetAll",
+                               g_variant_new("(s)", LOC_IFACE_NAME),  // args
+                               G_VARIANT_TYPE("(a{sv})"),             // return type
+                               G_DBUS_CALL_FLAGS_NONE, GET_ALL_TIMEOUT_MSEC,
+                               m_cancellable.get(), on_get_all_reply, bootstrap);
     }
 
-    static std::tuple<bool, std::string> get_string_reply_from_call(GObject* source, GAsyncResult* res)
+    static void on_get_all_reply(GObject* source_object, GAsyncResult* res, gpointer gbootstrap)
     {
+        auto bootstrap = static_cast<Bootstrap*>(gbootstrap);
         GError* error;
         GVariant* v;
-        bool success{false};
-        std::string result{""};
 
         error = nullptr;
-        GDBusConnection* conn = G_DBUS_CONNECTION(source);
-        v = g_dbus_connection_call_finish(conn, res, &error);
+        v = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source_object), res, &error);
+        TRACE2(get_reply, "*", int(v != nullptr));
+        StartupTimeline::get().mark(StartupTimeline::FIRST_REPLY);
+        if ((v != nullptr) && !bootstrap->is_cancelled())
+        {
+            GVariant* dict{};
+            g_variant_get(v, "(@a{sv})", &dict);
+            for (int i = 0; i < N_PROPS; ++i)
+            {
+                // a value of the wrong type is as good as a missing one
+                const auto& property = bootstrap->self->remote_property(PropertyIndex(i));
+                GVariant* value = g_variant_lookup_value(dict, property.name(), nullptr);
+                if ((value != nullptr) && !property.accepts(value))
+                {
+                    g_clear_pointer(&value, g_variant_unref);
+                }
+                bootstrap->set_value(PropertyIndex(i), value);
+            }
+            g_variant_unref(dict);
+        }
         if (v != nullptr)
         {
-            GVariant* inner{};
-            g_variant_get(v, "(v)", &inner);
-            success = true;
-            result = g_variant_get_string(inner, nullptr);
-            g_variant_unref(inner);
             g_variant_unref(v);
         }
         else if (error != nullptr)
         {
             if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
             {
-                g_warning("Error calling dbus method: %s", error->message);
+                g_debug("GetAll failed: %s", error->message);
             }
             g_error_free(error);
-            success = false;
         }
 
-        return std::make_tuple(success, result);
+        if (bootstrap->is_cancelled())
+        {
+            delete bootstrap;
+        }
+        else if (bootstrap->have_all_values())
+        {
+            finish_bootstrap(bootstrap);
+        }
+        else
+        {
+            g_debug("GetAll didn't return all the properties; falling back to Get");
+            bootstrap->method = "Get";
+            bootstrap->self->start_bootstrap_gets(G_DBUS_CONNECTION(source_object), bootstrap);
+        }
     }
 
-    static void on_loc_enabled_reply(GObject* source_object, GAsyncResult* res, gpointer gself)
+    void start_bootstrap_gets(GDBusConnection* system_bus, Bootstrap* bootstrap)
     {
-        bool success, value;
-        std::tie(success, value) = get_bool_reply_from_call(source_object, res);
-        g_debug("service loc reply: success %d value %d", int(success), int(value));
-        if (success)
+        // fire them all off at once rather than waiting on each reply
+        bootstrap->n_pending = N_PROPS;
+        bootstrap->generation = m_generation;
+        for (auto& get : bootstrap->gets)
         {
-            static_cast<Impl*>(gself)->m_loc_enabled.set(value);
+            const auto key = key_for_property(get.prop);
+            TRACE1(get_issued, key);
+            g_dbus_connection_call(system_bus, BUS_NAME, OBJECT_PATH, PROP_IFACE_NAME, "Get",
+                                   g_variant_new("(ss)", LOC_IFACE_NAME, key),  // args
+                                   G_VARIANT_TYPE("(v)"),                       // return type
+                                   G_DBUS_CALL_FLAGS_NONE,
+                                   -1,  // use default timeout
+                                   m_cancellable.get(), on_bootstrap_get_reply, &get);
         }
     }
 
-    static void on_gps_enabled_reply(GObject* source_object, GAsyncResult* res, gpointer gself)
+    static void on_bootstrap_get_done(Bootstrap* bootstrap)
     {
-        bool success, value;
-        std::tie(success, value) = get_bool_reply_from_call(source_object, res);
-        g_debug("service gps reply: success %d value %d", int(success), int(value));
-        if (success)
+        if (--bootstrap->n_pending > 0)
+        {
+            return;
+        }
+
+        if (bootstrap->is_cancelled())
+        {
+            delete bootstrap;
+        }
+        else
         {
-            static_cast<Impl*>(gself)->m_gps_enabled.set(value);
+            finish_bootstrap(bootstrap);
         }
     }
 
-    static void on_loc_state_reply(GObject* source_object, GAsyncResult* res, gpointer gself)
+    // A PropertiesChanged that arrived after we asked for a value is
+    // fresher than the reply, so don't let the reply roll it back.
+    bool is_current_reply(const Bootstrap* bootstrap, PropertyIndex prop, bool have_value)
     {
-        bool success;
-        std::string state_str;
-        std::tie(success, state_str) = get_string_reply_from_call(source_object, res);
-        g_debug("service state reply: success %d value '%s'", int(success), state_str.c_str());
-        if (success)
+        if (!have_value)
         {
-            static_cast<Impl*>(gself)->m_loc_active.set(state_str == "active");
+            return false;
         }
+
+        if (bootstrap->generation[prop] != m_generation[prop])
+        {
+            g_debug("dropping stale reply for property #%d", int(prop));
+            count(&Stats::stale_replies_dropped);
+            return false;
+        }
+
+        return true;
+    }
+
+    static void finish_bootstrap(Bootstrap* bootstrap)
+    {
+        auto self = bootstrap->self;
+
+        if (bootstrap->appearance != self->m_appearance)
+        {
+            g_debug("discarding bootstrap: location-service vanished while it was in flight");
+        }
+        else
+        {
+            for (int i = 0; i < N_PROPS; ++i)
+            {
+                const auto prop = PropertyIndex(i);
+                if (self->is_current_reply(bootstrap, prop, bootstrap->values[prop] != nullptr))
+                {
+                    self->remote_property(prop).update(bootstrap->values[prop]);
+                }
+            }
+
+            const auto elapsed_usec = g_get_monotonic_time() - bootstrap->start_time;
+            g_debug("setting is_valid to true: location-service ready after %.1f ms via %s", elapsed_usec / 1000.0,
+                    bootstrap->method);
+            if (self->remove_timeout(self->m_invalidate_tag))
+            {
+                self->count(&Stats::outages_hidden);
+                Metrics::get().increment(Metrics::COUNTER_OUTAGES_HIDDEN);
+            }
+            self->m_is_valid.set(true);
+            self->m_is_seeded.set(false);
+            self->publish();
+        }
+
+        delete bootstrap;
     }
 
     /***
     ****  org.freedesktop.dbus.properties.Set handling
     ***/
 
-    void set_bool_property(const char* property_name, bool b)
+    // Only one Set per property is on the wire at a time. Requests made
+    // while one is in flight collapse into a single pending value that's
+    // sent when the reply comes back, so the service always ends up with
+    // the most recently requested value.
+    struct SetSlot
+    {
+        bool in_flight{false};
+        bool in_flight_value{false};
+        bool has_pending{false};
+        bool pending_value{false};
+    };
+
+    struct SetCall : public CallData
+    {
+        SetCall(Impl* self_, PropertyIndex prop_)
+            : CallData(self_)
+            , prop(prop_)
+        {
+        }
+
+        const PropertyIndex prop;
+    };
+
+    void set_bool_property(PropertyIndex prop, bool b)
+    {
+        auto& slot = m_set_slots[prop];
+        count(&Stats::set_requests);
+
+        // hold it if there's one on the wire or nothing to send it on yet
+        if (slot.in_flight || !m_system_bus)
+        {
+            if (slot.has_pending)
+            {
+                count(&Stats::sets_coalesced);
+            }
+            else
+            {
+                ++m_sets_held;
+            }
+            slot.has_pending = true;
+            slot.pending_value = b;
+            return;
+        }
+
+        send_set(prop, b);
+    }
+
+    void send_set(PropertyIndex prop, bool b)
     {
-        g_return_if_fail(m_system_bus);
+        auto& slot = m_set_slots[prop];
+        slot.in_flight = true;
+        slot.in_flight_value = b;
+        count(&Stats::sets_sent);
+        TRACE2(set_issued, key_for_property(prop), int(b));
 
-        auto args = g_variant_new("(ssv)", LOC_IFACE_NAME, property_name, g_variant_new_boolean(b));
+        auto args = g_variant_new("(ssv)", LOC_IFACE_NAME, key_for_property(prop), g_variant_new_boolean(b));
         g_dbus_connection_call(m_system_bus.get(), BUS_NAME, OBJECT_PATH, PROP_IFACE_NAME,
                                "Set",  // method name,
                                args,
                                nullptr,  // reply type
                                G_DBUS_CALL_FLAGS_NONE,
                                -1,  // timeout msec
-                               m_cancellable.get(), check_method_call_reply, this);
+                               m_cancellable.get(), on_set_reply, new SetCall(this, prop));
+    }
+
+    static void on_set_reply(GObject* connection, GAsyncResult* res, gpointer gcall)
+    {
+        auto call = static_cast<SetCall*>(gcall);
+        const bool success = check_method_call_reply(connection, res);
+        TRACE2(set_done, call->self->key_for_property(call->prop), int(success));
+
+        if (!call->is_cancelled())
+        {
+            call->self->on_set_done(call->prop, success);
+        }
+
+        delete call;
+    }
+
+    void on_set_done(PropertyIndex prop, bool success)
+    {
+        auto& slot = m_set_slots[prop];
+        slot.in_flight = false;
+
+        if (!slot.has_pending)
+        {
+            if (!success)
+            {
+                report_set_failure(prop);
+            }
+            return;
+        }
+
+        release_held_set(slot);
+        if (success && (slot.pending_value == slot.in_flight_value))
+        {
+            // the service already has the value we were going to send
+            count(&Stats::sets_coalesced);
+            return;
+        }
+
+        send_set(prop, slot.pending_value);
+    }
+
+    const char* key_for_property(PropertyIndex prop) const
+    {
+        return m_remote_properties[prop].remote->name();
+    }
+
+    // returns N_PROPS if it's not a property we mirror
+    PropertyIndex property_for_key(const char* key) const
+    {
+        for (int i = 0; i < N_PROPS; ++i)
+        {
+            if (!g_strcmp0(key, key_for_property(PropertyIndex(i))))
+            {
+                return PropertyIndex(i);
+            }
+        }
+
+        return N_PROPS;
+    }
+
+    RemotePropertyBase& remote_property(PropertyIndex prop)
+    {
+        return *m_remote_properties[prop].remote;
+    }
+
+    void release_held_set(SetSlot& slot)
+    {
+        slot.has_pending = false;
+        --m_sets_held;
+    }
+
+    // sends the Sets requested before we had a bus
+    void send_held_sets()
+    {
+        for (int i = 0; i < N_PROPS; ++i)
+        {
+            auto& slot = m_set_slots[i];
+            if (slot.has_pending && !slot.in_flight)
+            {
+                release_held_set(slot);
+                send_set(PropertyIndex(i), slot.pending_value);
+            }
+        }
     }
 
-    static void check_method_call_reply(GObject* connection, GAsyncResult* res, gpointer /*gself*/)
+    void fail_held_sets()
+    {
+        for (int i = 0; i < N_PROPS; ++i)
+        {
+            auto& slot = m_set_slots[i];
+            if (slot.has_pending)
+            {
+                release_held_set(slot);
+                report_set_failure(PropertyIndex(i));
+            }
+        }
+    }
+
+    static Controller::Setting setting_for_property(PropertyIndex prop)
+    {
+        return prop == PROP_GPS_ENABLED ? Controller::Setting::GPS_ENABLED
+                                        : Controller::Setting::LOCATION_SERVICE_ENABLED;
+    }
+
+    static bool check_method_call_reply(GObject* connection, GAsyncResult* res)
     {
         GError* error;
         GVariant* v;
@@ -346,8 +1269,10 @@ private:
             g_debug("method call returned '%s'", vs);
             g_free(vs);
             g_variant_unref(v);
+            return true;
         }
-        else if (error != nullptr)
+
+        if (error != nullptr)
         {
             if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
             {
@@ -356,6 +1281,8 @@ private:
 
             g_error_free(error);
         }
+
+        return false;
     }
 
     /***
@@ -366,27 +1293,110 @@ private:
     static constexpr const char* OBJECT_PATH{"/com/ubuntu/location/Service"};
     static constexpr const char* LOC_IFACE_NAME{"com.ubuntu.location.Service"};
     static constexpr const char* PROP_IFACE_NAME{"org.freedesktop.DBus.Properties"};
-    static constexpr const char* PROP_KEY_LOC_ENABLED{"IsOnline"};
-    static constexpr const char* PROP_KEY_GPS_ENABLED{"DoesSatelliteBasedPositioning"};
-    static constexpr const char* PROP_KEY_LOC_STATE{"State"};
 
-    core::Property<bool> m_gps_enabled{false};
-    core::Property<bool> m_loc_enabled{false};
-    core::Property<bool> m_loc_active{false};
+    static constexpr guint FLAP_WINDOW_MSEC{10000};  // vanishing sooner than this after appearing is a flap
+    static constexpr guint BACKOFF_BASE_MSEC{250};
+    static constexpr guint BACKOFF_MAX_MSEC{30000};
+    static constexpr guint DEFAULT_OUTAGE_GRACE_MSEC{1500};
+    static constexpr gint GET_ALL_TIMEOUT_MSEC{1500};  // then fall back to Get
+
+    // the service's State is "disabled", "enabled", or "active"
+    struct LocStateIsActive
+    {
+        typedef bool value_type;
+        static const EnumValue<bool> (&values())[3]
+        {
+            static const EnumValue<bool> table[] = {{"disabled", false}, {"enabled", false}, {"active", true}};
+            return table;
+        }
+        static bool fallback()
+        {
+            return false;
+        }
+    };
+
+    // A mirrored property's D-Bus name & decoder, and the value it's decoded into
+    struct MirroredProperty
+    {
+        RemotePropertyBase* remote;
+        core::Property<bool>* value;
+    };
+
+    template <typename Decoder>
+    static MirroredProperty mirror(RemoteProperty<bool, Decoder>& property)
+    {
+        return {&property, &property};
+    }
+
+    // The properties that we mirror. m_remote_properties is the only list
+    // of them: everything else, from matching PropertiesChanged keys to
+    // the main thread's copies, is driven from it by PropertyIndex.
+    RemoteProperty<bool> m_loc_enabled{"IsOnline"};
+    RemoteProperty<bool> m_gps_enabled{"DoesSatelliteBasedPositioning"};
+    RemoteProperty<bool, EnumDecoder<LocStateIsActive>> m_loc_active{"State"};
+    const std::array<MirroredProperty, N_PROPS> m_remote_properties{
+        {mirror(m_loc_enabled), mirror(m_gps_enabled), mirror(m_loc_active)}};
     core::Property<bool> m_is_valid{false};
+    core::Property<bool> m_is_seeded{false};  // valid only because of the seed
+    std::vector<core::ScopedConnection> m_connections;
+    bool m_dirty{false};  // changed since the last snapshot was published
+
+    // what the main thread's clients see; only touched on the main thread
+    struct MainState
+    {
+        core::Property<bool> is_valid{false};
+        core::Property<bool> is_seeded{false};
+        std::array<core::Property<bool>, N_PROPS> values;  // by PropertyIndex
+    } m_main;
+    core::Signal<Controller::Setting> m_set_failed;
+
+    const bool m_lazy;
+    bool m_activation_requested{false};
+    bool m_service_present{false};
+
+    // incremented each time the service appears or vanishes
+    unsigned int m_appearance{0};
+
+    // flap protection
+    std::string m_name_owner;
+    gint64 m_appeared_at{0};
+    unsigned int m_flaps{0};  // consecutive short-lived appearances
+    guint m_attach_tag{0};
+    guint m_invalidate_tag{0};
+    unsigned int m_outage_grace_msec{DEFAULT_OUTAGE_GRACE_MSEC};
+
+    // incremented each time a property's value arrives via PropertiesChanged
+    std::array<unsigned int, N_PROPS> m_generation{};
+
+    std::array<SetSlot, N_PROPS> m_set_slots{};
+
+    // read from the main thread by is_busy()
+    std::atomic<unsigned int> m_calls_in_flight{0};      // async calls whose replies we're still waiting for
+    std::atomic<unsigned int> m_requests_in_transit{0};  // posted by the main thread but not yet run
+    std::atomic<unsigned int> m_sets_held{0};            // SetSlots with a pending value
+
+    mutable std::mutex m_stats_mutex;
+    LocationServiceController::Stats m_stats{};
 
     std::shared_ptr<GCancellable> m_cancellable{};
     std::shared_ptr<GDBusConnection> m_system_bus{};
     std::shared_ptr<guint> m_name_tag{};
     std::shared_ptr<guint> m_signal_tag{};
+
+    GMainContext* const m_main_context;  // where the snapshots go
+    GMainContext* const m_context;       // the worker's
+    GMainLoop* const m_loop;
+    const std::shared_ptr<Impl*> m_owner;  // for posted callbacks; cleared when we're going away
+    std::unique_ptr<Handoff> m_handoff;  // from the worker to the main thread
+    std::thread m_thread;
 };
 
 /***
 ****
 ***/
 
-LocationServiceController::LocationServiceController()
-    : impl{new Impl{}}
+LocationServiceController::LocationServiceController(bool lazy, const Snapshot* seed)
+    : impl{new Impl{lazy, seed}}
 {
 }
 
@@ -423,3 +1433,33 @@ void LocationServiceController::set_location_service_enabled(bool enabled)
 {
     impl->set_location_service_enabled(enabled);
 }
+
+const core::Signal<Controller::Setting>& LocationServiceController::set_failed() const
+{
+    return impl->set_failed();
+}
+
+const core::Property<bool>& LocationServiceController::is_seeded() const
+{
+    return impl->is_seeded();
+}
+
+void LocationServiceController::request_activation()
+{
+    impl->request_activation();
+}
+
+bool LocationServiceController::is_busy() const
+{
+    return impl->is_busy();
+}
+
+LocationServiceController::Stats LocationServiceController::stats() const
+{
+    return impl->stats();
+}
+
+void LocationServiceController::set_outage_grace_msec(unsigned int msec)
+{
+    impl->set_outage_grace_msec(msec);
+}
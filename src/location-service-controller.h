@@ -23,10 +23,23 @@
 
 #include <memory>  // std::unique_ptr
 
+/**
+ * Mirrors ubuntu-location-service's state. Its system bus traffic runs on
+ * a thread of its own, but it's used from the main thread: that's where its
+ * properties change and its signals are emitted.
+ */
 class LocationServiceController : public Controller
 {
 public:
-    LocationServiceController();
+    /// If lazy is false, the location service is started as soon as we
+    /// have a bus. Otherwise we only attach to it if it's already running,
+    /// and don't start it until request_activation() is called.
+    ///
+    /// If 'seed' isn't null, e.g. it's the last known state from a StateCache,
+    /// it's shown until the location service's own values arrive. If the
+    /// service is gone, it's shown for the outage grace period, or in lazy
+    /// mode until the service is activated.
+    explicit LocationServiceController(bool lazy = false, const Snapshot* seed = nullptr);
     virtual ~LocationServiceController();
 
     const core::Property<bool>& is_valid() const override;
@@ -35,6 +48,27 @@ public:
     const core::Property<bool>& location_service_active() const override;
     void set_gps_enabled(bool enabled) override;
     void set_location_service_enabled(bool enabled) override;
+    const core::Signal<Setting>& set_failed() const override;
+    void request_activation() override;
+    bool is_busy() const override;
+    const core::Property<bool>& is_seeded() const override;
+
+    struct Stats
+    {
+        unsigned int stale_replies_dropped{0};  // Get replies superseded by a newer PropertiesChanged
+        unsigned int set_requests{0};           // calls to set_gps_enabled() / set_location_service_enabled()
+        unsigned int sets_sent{0};              // Set calls actually sent to the location service
+        unsigned int sets_coalesced{0};         // requests superseded before they were sent
+        unsigned int outages_hidden{0};         // vanishings that were over before is_valid had to change
+        unsigned int backoffs{0};               // reappearances whose bootstrap was delayed for flapping
+        unsigned int cycles_suppressed{0};      // appear/vanish cycles over before we'd bootstrapped
+        unsigned int invalidations{0};          // properties re-fetched because PropertiesChanged invalidated them
+    };
+    Stats stats() const;
+
+    /// How long the location service may be gone before is_valid goes false.
+    /// A service that restarts within this time doesn't disturb the UI.
+    void set_outage_grace_msec(unsigned int msec);
 
     LocationServiceController(const LocationServiceController&) = delete;
     LocationServiceController& operator=(const LocationServiceController&) = delete;
@@ -18,34 +18,131 @@
  */
 
 #include <locale.h>
+#include <signal.h>
 #include <glib/gi18n.h>
 #include <glib.h>
+#include <glib-unix.h>
+
+#include <vector>
 
 #include "location-service-controller.h"
 #include "service.h"
+#include "startup-timeline.h"
+#include "state-cache.h"
+#include "unity-screen-display-state.h"
+#include "wakeup-audit.h"
 
 static void on_name_lost(Service* service G_GNUC_UNUSED, gpointer loop)
 {
     g_main_loop_quit(static_cast<GMainLoop*>(loop));
 }
 
-int main(int argc G_GNUC_UNUSED, char** argv G_GNUC_UNUSED)
+struct IdleExitData
 {
     GMainLoop* loop;
+    StateCache* state_cache;
+};
+
+static gboolean on_quit_signal(gpointer loop)
+{
+    g_main_loop_quit(static_cast<GMainLoop*>(loop));
+    return G_SOURCE_REMOVE;
+}
+
+static void on_idle_exit(Service* service G_GNUC_UNUSED, gpointer gdata)
+{
+    auto data = static_cast<IdleExitData*>(gdata);
+    data->state_cache->flush();
+    g_main_loop_quit(data->loop);
+}
+
+int main(int argc, char** argv)
+{
+    auto& timeline = StartupTimeline::get();
+    timeline.mark(StartupTimeline::PROCESS_START);
+
+    GMainLoop* loop;
+    gboolean optimistic_toggles = false;
+    gboolean lazy = false;
+    gint idle_exit_sec = 0;
+    gint active_hold_msec = 0;
+    gboolean audit_wakeups = false;
 
     /* boilerplate i18n */
     setlocale(LC_ALL, "");
     bindtextdomain(GETTEXT_PACKAGE, GNOMELOCALEDIR);
     textdomain(GETTEXT_PACKAGE);
+    timeline.mark(StartupTimeline::LOCALE_INIT);
+
+    /* command-line options */
+    GOptionEntry entries[] = {{"optimistic-toggles", 0, 0, G_OPTION_ARG_NONE, &optimistic_toggles,
+                               "Flip switches immediately instead of waiting for the location service", nullptr},
+                              {"lazy", 0, 0, G_OPTION_ARG_NONE, &lazy,
+                               "Don't start the location service until the menu is opened or a switch is used",
+                               nullptr},
+                              {"idle-exit", 0, 0, G_OPTION_ARG_INT, &idle_exit_sec,
+                               "Exit after SECONDS with no menu subscribers; rely on D-Bus activation to restart",
+                               "SECONDS"},
+                              {"active-hold-ms", 0, 0, G_OPTION_ARG_INT, &active_hold_msec,
+                               "Show the location-active icon for MSEC after the service goes idle (default: 0)",
+                               "MSEC"},
+                              {"audit-wakeups", 0, 0, G_OPTION_ARG_NONE, &audit_wakeups,
+                               "Log how often and why the service wakes up, once a minute", nullptr},
+                              {nullptr}};
+    GError* error = nullptr;
+    GOptionContext* context = g_option_context_new(nullptr);
+    g_option_context_add_main_entries(context, entries, nullptr);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+    if (audit_wakeups)
+    {
+        WakeupAudit::get().enable();
+    }
 
     /* set up the service */
     loop = g_main_loop_new(nullptr, false);
-    auto controller = std::make_shared<LocationServiceController>();
+
+    /* show the last known state until the location service answers */
+    StateCache state_cache(StateCache::default_filename());
+    Controller::Snapshot snapshot;
+    const bool have_snapshot = state_cache.load(snapshot);
+    auto controller = std::make_shared<LocationServiceController>(lazy, have_snapshot ? &snapshot : nullptr);
+    auto save_state = [&state_cache, &controller](bool)
+    {
+        if (controller->is_valid().get())
+        {
+            state_cache.save(controller->snapshot());
+        }
+    };
+    std::vector<core::ScopedConnection> connections;
+    connections.push_back(controller->is_valid().changed().connect(save_state));
+    connections.push_back(controller->gps_enabled().changed().connect(save_state));
+    connections.push_back(controller->location_service_enabled().changed().connect(save_state));
+
+    /* export it */
     Service service(controller);
     service.set_name_lost_callback(on_name_lost, loop);
+    service.get_phone_profile().set_optimistic_toggles(optimistic_toggles);
+    service.get_phone_profile().set_active_hold_msec(MAX(active_hold_msec, 0));
+    service.get_phone_profile().set_display_state(std::make_shared<UnityScreenDisplayState>());
+    IdleExitData idle_exit_data{loop, &state_cache};
+    if (idle_exit_sec > 0)
+    {
+        service.set_idle_exit(idle_exit_sec, on_idle_exit, &idle_exit_data);
+    }
+    /* systemd stops us with SIGTERM; don't lose a save that's still throttled */
+    g_unix_signal_add(SIGTERM, on_quit_signal, loop);
+    g_unix_signal_add(SIGINT, on_quit_signal, loop);
     g_main_loop_run(loop);
 
     /* cleanup */
+    state_cache.flush();
     g_main_loop_unref(loop);
     return 0;
 }
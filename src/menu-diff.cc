@@ -0,0 +1,98 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#include "menu-diff.h"
+
+GMenuItem* MenuItemSpec::create_item() const
+{
+    GMenuItem* item = g_menu_item_new(label.empty() ? nullptr : label.c_str(), action.c_str());
+
+    if (!type.empty())
+    {
+        g_menu_item_set_attribute(item, "x-canonical-type", "s", type.c_str());
+    }
+
+    return item;
+}
+
+/***
+****  The edit script comes from the longest common subsequence of the two
+****  specs: everything in it is kept, everything else in 'from' is removed,
+****  and everything else in 'to' is inserted. Menus are short, so the
+****  quadratic table is cheaper than anything cleverer.
+***/
+
+MenuDiff::Stats MenuDiff::apply(GMenu* menu, const MenuSpec& from, const MenuSpec& to)
+{
+    Stats stats;
+
+    g_return_val_if_fail(G_IS_MENU(menu), stats);
+    g_return_val_if_fail(gint(from.size()) == g_menu_model_get_n_items(G_MENU_MODEL(menu)), stats);
+
+    // lcs[i][j] is the length of the LCS of from[i...] and to[j...]
+    const size_t n_from = from.size();
+    const size_t n_to = to.size();
+    std::vector<std::vector<unsigned int>> lcs(n_from + 1, std::vector<unsigned int>(n_to + 1, 0));
+    for (size_t i = n_from; i-- > 0;)
+    {
+        for (size_t j = n_to; j-- > 0;)
+        {
+            if (from[i] == to[j])
+            {
+                lcs[i][j] = lcs[i + 1][j + 1] + 1;
+            }
+            else
+            {
+                lcs[i][j] = MAX(lcs[i + 1][j], lcs[i][j + 1]);
+            }
+        }
+    }
+
+    // walk the table front to back; 'pos' is where we are in the live menu
+    size_t i = 0;
+    size_t j = 0;
+    gint pos = 0;
+    while ((i < n_from) || (j < n_to))
+    {
+        if ((i < n_from) && (j < n_to) && (from[i] == to[j]))
+        {
+            ++stats.kept;
+            ++pos;
+            ++i;
+            ++j;
+        }
+        else if ((i < n_from) && ((j == n_to) || (lcs[i + 1][j] >= lcs[i][j + 1])))
+        {
+            g_menu_remove(menu, pos);
+            ++stats.removed;
+            ++i;
+        }
+        else
+        {
+            GMenuItem* item = to[j].create_item();
+            g_menu_insert_item(menu, pos, item);
+            g_object_unref(item);
+            ++stats.inserted;
+            ++pos;
+            ++j;
+        }
+    }
+
+    return stats;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <gio/gio.h>
+
+/**
+ * A declarative description of one menu item.
+ *
+ * Two specs that compare equal produce identical GMenuItems,
+ * so an item whose spec hasn't changed can be left alone.
+ */
+struct MenuItemSpec
+{
+    std::string label;   // translated; empty for none
+    std::string action;  // detailed action name, e.g. "indicator.settings::location"
+    std::string type;    // x-canonical-type; empty for a plain item
+
+    bool operator==(const MenuItemSpec& that) const
+    {
+        return label == that.label && action == that.action && type == that.type;
+    }
+    bool operator!=(const MenuItemSpec& that) const
+    {
+        return !(*this == that);
+    }
+
+    GMenuItem* create_item() const;
+};
+
+typedef std::vector<MenuItemSpec> MenuSpec;
+
+/**
+ * Brings a GMenu from one MenuSpec to another with the fewest item
+ * removals and insertions, so that exported menus only send what changed
+ * instead of a remove-all + re-add of every item.
+ *
+ * GMenu has no way to modify an item in place, so a changed item
+ * is a removal and an insertion at the same position.
+ */
+class MenuDiff
+{
+public:
+    struct Stats
+    {
+        unsigned int kept{0};      // items left untouched
+        unsigned int removed{0};   // items removed from the menu
+        unsigned int inserted{0};  // items inserted into the menu
+    };
+
+    /// 'menu' must currently hold exactly the items described by 'from'
+    static Stats apply(GMenu* menu, const MenuSpec& from, const MenuSpec& to);
+};
@@ -0,0 +1,217 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#include "menu-subscribers.h"
+#include "wakeup-audit.h"
+
+namespace
+{
+// Filters run in GDBus' worker thread, so everything they
+// look at is fixed when the filter is added.
+struct FilterData
+{
+    MenuSubscribers* self;
+    GMainContext* context;
+    GCancellable* cancellable;
+    std::string path_prefix;
+};
+
+void filter_data_free(gpointer gdata)
+{
+    auto data = static_cast<FilterData*>(gdata);
+    g_main_context_unref(data->context);
+    g_object_unref(data->cancellable);
+    delete data;
+}
+
+// a call we're interested in, passed from the worker thread to the main thread
+struct Call
+{
+    MenuSubscribers* self;
+    GCancellable* cancellable;
+    std::string sender;
+    int type;
+};
+
+void call_free(gpointer gcall)
+{
+    auto call = static_cast<Call*>(gcall);
+    g_object_unref(call->cancellable);
+    delete call;
+}
+}
+
+/***
+****
+***/
+
+MenuSubscribers::MenuSubscribers() = default;
+
+MenuSubscribers::~MenuSubscribers()
+{
+    stop();
+}
+
+void MenuSubscribers::start(GDBusConnection* connection, const char* path_prefix)
+{
+    g_return_if_fail(m_connection == nullptr);
+
+    m_connection = G_DBUS_CONNECTION(g_object_ref(connection));
+    m_cancellable = g_cancellable_new();
+
+    auto data = new FilterData{this, g_main_context_ref_thread_default(), G_CANCELLABLE(g_object_ref(m_cancellable)),
+                               path_prefix};
+    m_filter_id = g_dbus_connection_add_filter(connection, filter_func, data, filter_data_free);
+}
+
+void MenuSubscribers::stop()
+{
+    if (m_connection == nullptr)
+    {
+        return;
+    }
+
+    // the filter may still be running in the worker thread,
+    // so this is how it knows that we're gone
+    g_cancellable_cancel(m_cancellable);
+    g_clear_object(&m_cancellable);
+    g_dbus_connection_remove_filter(m_connection, m_filter_id);
+    m_filter_id = 0;
+
+    for (auto& it : m_subscribers)
+    {
+        g_bus_unwatch_name(it.second.watch_tag);
+    }
+    m_subscribers.clear();
+    m_count.set(0);
+
+    g_clear_object(&m_connection);
+}
+
+GDBusMessage* MenuSubscribers::filter_func(GDBusConnection*, GDBusMessage* message, gboolean incoming, gpointer gdata)
+{
+    auto data = static_cast<FilterData*>(gdata);
+
+    if (!incoming || (g_dbus_message_get_message_type(message) != G_DBUS_MESSAGE_TYPE_METHOD_CALL) ||
+        !g_str_has_prefix(g_dbus_message_get_path(message), data->path_prefix.c_str()))
+    {
+        return message;
+    }
+
+    const char* iface = g_dbus_message_get_interface(message);
+    const char* member = g_dbus_message_get_member(message);
+    int type = -1;
+    if (!g_strcmp0(iface, "org.gtk.Menus"))
+    {
+        if (!g_strcmp0(member, "Start"))
+        {
+            type = MENUS_START;
+        }
+        else if (!g_strcmp0(member, "End"))
+        {
+            type = MENUS_END;
+        }
+    }
+    else if (!g_strcmp0(iface, "org.gtk.Actions"))
+    {
+        if (!g_strcmp0(member, "DescribeAll") || !g_strcmp0(member, "Describe"))
+        {
+            type = ACTIONS_DESCRIBE;
+        }
+    }
+
+    // GDBus dispatches the call itself from a default-priority idle,
+    // so at high priority we get to look at it first
+    if (type != -1)
+    {
+        auto call = new Call{data->self, G_CANCELLABLE(g_object_ref(data->cancellable)),
+                             g_dbus_message_get_sender(message), type};
+        g_main_context_invoke_full(data->context, G_PRIORITY_HIGH, on_call, call, call_free);
+    }
+
+    return message;
+}
+
+gboolean MenuSubscribers::on_call(gpointer gcall)
+{
+    auto call = static_cast<Call*>(gcall);
+    WakeupAudit::attribute(WakeupAudit::SOURCE_SESSION_BUS_CALL);
+
+    if (!g_cancellable_is_cancelled(call->cancellable))
+    {
+        switch (call->type)
+        {
+            case MENUS_START:
+                call->self->on_start(call->sender);
+                break;
+
+            case MENUS_END:
+                call->self->on_end(call->sender);
+                break;
+
+            case ACTIONS_DESCRIBE:
+                call->self->m_actions_described();
+                break;
+        }
+    }
+
+    return G_SOURCE_REMOVE;
+}
+
+void MenuSubscribers::on_start(const std::string& sender)
+{
+    auto& subscriber = m_subscribers[sender];
+
+    if (subscriber.n_subscriptions++ == 0)
+    {
+        g_debug("menu subscriber '%s' appeared", sender.c_str());
+        subscriber.watch_tag =
+            g_bus_watch_name_on_connection(m_connection, sender.c_str(), G_BUS_NAME_WATCHER_FLAGS_NONE, nullptr,
+                                           on_subscriber_vanished, this, nullptr);
+        m_count.set(m_subscribers.size());
+    }
+}
+
+void MenuSubscribers::on_end(const std::string& sender)
+{
+    auto it = m_subscribers.find(sender);
+
+    if ((it != m_subscribers.end()) && (--it->second.n_subscriptions == 0))
+    {
+        remove(sender);
+    }
+}
+
+void MenuSubscribers::on_subscriber_vanished(GDBusConnection*, const gchar* name, gpointer gself)
+{
+    static_cast<MenuSubscribers*>(gself)->remove(name);
+}
+
+void MenuSubscribers::remove(const std::string& sender)
+{
+    auto it = m_subscribers.find(sender);
+
+    if (it != m_subscribers.end())
+    {
+        g_debug("menu subscriber '%s' went away", sender.c_str());
+        g_bus_unwatch_name(it->second.watch_tag);
+        m_subscribers.erase(it);
+        m_count.set(m_subscribers.size());
+    }
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+#include <map>
+#include <string>
+
+#include <gio/gio.h>
+
+#include <core/property.h>
+
+/**
+ * Tracks which bus clients are subscribed to the menus we export.
+ *
+ * GDBusMenuModel clients call org.gtk.Menus.Start when they want a
+ * menu's contents and End when they're done. We watch for those calls
+ * on the connection, and for subscribers that leave the bus without
+ * calling End.
+ *
+ * We also report org.gtk.Actions Describe/DescribeAll calls, since a
+ * client asking for action states needs them to be current. Both are
+ * reported to the main thread before GDBus dispatches the call itself.
+ * Describing doesn't make a client a subscriber: org.gtk.Actions has
+ * no End, so there'd be no telling when it stopped listening.
+ */
+class MenuSubscribers
+{
+public:
+    MenuSubscribers();
+    ~MenuSubscribers();
+
+    /// Start watching calls to menus exported at or below path_prefix
+    void start(GDBusConnection* connection, const char* path_prefix);
+    void stop();
+
+    /// The number of clients subscribed to at least one menu
+    const core::Property<unsigned int>& count() const
+    {
+        return m_count;
+    }
+
+    /// Emitted when a client asks for the state of our actions
+    const core::Signal<void>& actions_described() const
+    {
+        return m_actions_described;
+    }
+
+    MenuSubscribers(const MenuSubscribers&) = delete;
+    MenuSubscribers& operator=(const MenuSubscribers&) = delete;
+
+private:
+    struct Subscriber
+    {
+        unsigned int n_subscriptions{0};
+        guint watch_tag{0};
+    };
+
+    enum CallType
+    {
+        MENUS_START,
+        MENUS_END,
+        ACTIONS_DESCRIBE
+    };
+
+    void on_start(const std::string& sender);
+    void on_end(const std::string& sender);
+    void remove(const std::string& sender);
+    static GDBusMessage* filter_func(GDBusConnection*, GDBusMessage*, gboolean incoming, gpointer);
+    static gboolean on_call(gpointer gcall);
+    static void on_subscriber_vanished(GDBusConnection*, const gchar* name, gpointer gself);
+
+    core::Property<unsigned int> m_count{0};
+    core::Signal<void> m_actions_described;
+    std::map<std::string, Subscriber> m_subscribers;
+    GDBusConnection* m_connection{nullptr};
+    GCancellable* m_cancellable{nullptr};
+    guint m_filter_id{0};
+};
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#include <time.h>  // clock_gettime()
+
+#include "metrics.h"
+
+/***
+****  Histogram
+***/
+
+constexpr unsigned int Histogram::N_BUCKETS;
+
+unsigned int Histogram::bucket_for(guint64 nsec)
+{
+    if (nsec < 2)
+    {
+        return 0;
+    }
+
+    // index of the highest set bit
+    const unsigned int bucket = 63 - __builtin_clzll(nsec);
+    return MIN(bucket, N_BUCKETS - 1);
+}
+
+void Histogram::add(guint64 nsec)
+{
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(nsec, std::memory_order_relaxed);
+    m_buckets[bucket_for(nsec)].fetch_add(1, std::memory_order_relaxed);
+
+    auto max = m_max.load(std::memory_order_relaxed);
+    while ((nsec > max) && !m_max.compare_exchange_weak(max, nsec, std::memory_order_relaxed))
+    {
+    }
+}
+
+void Histogram::reset()
+{
+    m_count.store(0, std::memory_order_relaxed);
+    m_sum.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+    for (auto& n : m_buckets)
+    {
+        n.store(0, std::memory_order_relaxed);
+    }
+}
+
+/***
+****  Metrics
+***/
+
+Metrics& Metrics::get()
+{
+    static Metrics metrics;
+    return metrics;
+}
+
+const char* Metrics::stage_name(Stage stage)
+{
+    static const char* const names[N_STAGES] = {"signal-decode", "property-fanout", "header-build", "export-emit",
+                                                "thread-handoff"};
+
+    return names[stage];
+}
+
+const char* Metrics::counter_name(Counter counter)
+{
+    static const char* const names[N_COUNTERS] = {"outages-hidden", "backoffs", "cycles-suppressed"};
+
+    return names[counter];
+}
+
+guint64 Metrics::now_nsec()
+{
+    // g_get_monotonic_time() is too coarse for most of these stages
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return guint64(ts.tv_sec) * G_GUINT64_CONSTANT(1000000000) + guint64(ts.tv_nsec);
+}
+
+void Metrics::reset()
+{
+    for (auto& histogram : m_histograms)
+    {
+        histogram.reset();
+    }
+
+    for (auto& counter : m_counters)
+    {
+        counter.store(0, std::memory_order_relaxed);
+    }
+}
+
+GVariant* Metrics::create_variant() const
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{s(tttat)}"));
+
+    for (int i = 0; i < N_STAGES; ++i)
+    {
+        const auto& histogram = m_histograms[i];
+
+        GVariantBuilder buckets;
+        g_variant_builder_init(&buckets, G_VARIANT_TYPE("at"));
+        for (unsigned int j = 0; j < Histogram::N_BUCKETS; ++j)
+        {
+            g_variant_builder_add(&buckets, "t", histogram.bucket(j));
+        }
+
+        g_variant_builder_add(&builder, "{s(ttt@at)}", stage_name(Stage(i)), histogram.count(), histogram.sum(),
+                              histogram.max(), g_variant_builder_end(&buckets));
+    }
+
+    return g_variant_builder_end(&builder);
+}
+
+GVariant* Metrics::create_counters_variant() const
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{st}"));
+
+    for (int i = 0; i < N_COUNTERS; ++i)
+    {
+        g_variant_builder_add(&builder, "{st}", counter_name(Counter(i)), counter(Counter(i)));
+    }
+
+    return g_variant_builder_end(&builder);
+}
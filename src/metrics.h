@@ -0,0 +1,155 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include <glib.h>
+
+/**
+ * A fixed-size histogram of durations in nanoseconds.
+ *
+ * Bucket i counts samples in [2^i, 2^(i+1)) ns, except that bucket 0
+ * also holds anything under 1 ns and the last bucket anything too big
+ * for the others. Adding a sample never allocates or locks, so samples
+ * can come from any thread.
+ */
+class Histogram
+{
+public:
+    static constexpr unsigned int N_BUCKETS{32};
+
+    void add(guint64 nsec);
+    void reset();
+
+    guint64 count() const
+    {
+        return m_count.load(std::memory_order_relaxed);
+    }
+    guint64 sum() const
+    {
+        return m_sum.load(std::memory_order_relaxed);
+    }
+    guint64 max() const
+    {
+        return m_max.load(std::memory_order_relaxed);
+    }
+    guint64 bucket(unsigned int i) const
+    {
+        return m_buckets[i].load(std::memory_order_relaxed);
+    }
+
+    static unsigned int bucket_for(guint64 nsec);
+
+private:
+    std::atomic<guint64> m_count{0};
+    std::atomic<guint64> m_sum{0};
+    std::atomic<guint64> m_max{0};
+    std::array<std::atomic<guint64>, N_BUCKETS> m_buckets{};
+};
+
+/**
+ * Per-stage timings of the path from a location-service signal
+ * arriving on the system bus to the state change leaving on the
+ * session bus, plus counts of events worth watching for.
+ * Exposed over D-Bus by Service's Debug interface.
+ *
+ * The location-service controller records from its own thread,
+ * so everything here is safe to update from any thread.
+ */
+class Metrics
+{
+public:
+    enum Stage
+    {
+        STAGE_SIGNAL_DECODE,    // unpacking a PropertiesChanged signal
+        STAGE_PROPERTY_FANOUT,  // a controller property notifying its listeners
+        STAGE_HEADER_BUILD,     // picking or rebuilding the header state
+        STAGE_EXPORT_EMIT,      // handing an action's new state to the exported group
+        STAGE_THREAD_HANDOFF,   // a controller state change waiting for the main thread to pick it up
+        N_STAGES
+    };
+
+    enum Counter
+    {
+        COUNTER_OUTAGES_HIDDEN,     // location-service vanishings kept from the UI
+        COUNTER_BACKOFFS,           // location-service bootstraps delayed for flapping
+        COUNTER_CYCLES_SUPPRESSED,  // location-service appear/vanish cycles we never bootstrapped
+        N_COUNTERS
+    };
+
+    static Metrics& get();
+    static const char* stage_name(Stage stage);
+    static const char* counter_name(Counter counter);
+    static guint64 now_nsec();
+
+    void record(Stage stage, guint64 nsec)
+    {
+        m_histograms[stage].add(nsec);
+    }
+
+    const Histogram& histogram(Stage stage) const
+    {
+        return m_histograms[stage];
+    }
+
+    void increment(Counter counter)
+    {
+        m_counters[counter].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    guint64 counter(Counter counter) const
+    {
+        return m_counters[counter].load(std::memory_order_relaxed);
+    }
+
+    void reset();
+
+    /// Returns a floating a{s(tttat)} of stage name to
+    /// (count, sum in ns, max in ns, bucket counts)
+    GVariant* create_variant() const;
+
+    /// Returns a floating a{st} of counter name to count
+    GVariant* create_counters_variant() const;
+
+    /// Records the lifespan of the timer into a stage's histogram
+    class ScopedTimer
+    {
+    public:
+        explicit ScopedTimer(Stage stage)
+            : m_stage(stage)
+            , m_start(now_nsec())
+        {
+        }
+        ~ScopedTimer()
+        {
+            Metrics::get().record(m_stage, now_nsec() - m_start);
+        }
+
+    private:
+        const Stage m_stage;
+        const guint64 m_start;
+    };
+
+private:
+    std::array<Histogram, N_STAGES> m_histograms{};
+    std::array<std::atomic<guint64>, N_COUNTERS> m_counters{};
+};
@@ -19,65 +19,331 @@
 
 #include <array>
 
-#include <glib/gi18n.h>
+#include <locale.h>  // setlocale()
 
-#include <url-dispatcher.h>
-#include <ubuntu-app-launch.h>
+#include <glib/gi18n.h>
 
+#include "metrics.h"
 #include "phone.h"
+#include "startup-timeline.h"
+#include "tracepoints.h"
+#include "uri-dispatcher.h"
 #include "utils.h"  // GObjectDeleter
+#include "wakeup-audit.h"
 
 #define PROFILE_NAME "phone"
 
+#define HEADER_ACTION_KEY PROFILE_NAME "-header"
 #define LOCATION_ACTION_KEY "location-detection-enabled"
 #define GPS_ACTION_KEY "gps-detection-enabled"
+#define SETTINGS_ACTION_KEY "settings"
+
+/***
+****  The action table
+****
+****  Everything the phone profile exports: each action, where its state
+****  comes from, when it's enabled, and the submenu item that shows it.
+****  The actions and the submenu are generated from this once; after that
+****  Phone updates the actions through handles instead of by name.
+***/
+
+namespace
+{
+enum StateSource
+{
+    STATE_NONE,
+    STATE_HEADER,
+    STATE_LOCATION,
+    STATE_GPS
+};
+
+enum EnabledRule
+{
+    ENABLED_ALWAYS,
+    ENABLED_WHEN_VALID  // only while we can talk to the location service
+};
+
+enum Activation
+{
+    ACTIVATE_NONE,
+    ACTIVATE_TOGGLE,
+    ACTIVATE_SETTINGS
+};
+
+struct ActionInfo
+{
+    const char* key;
+    const char* parameter_type;  // or nullptr
+    StateSource state;
+    EnabledRule enabled;
+    Activation activation;
+    const char* menu_label;   // untranslated, or nullptr if it's not in the submenu
+    const char* menu_target;  // appended to the menu item's action name
+    const char* menu_type;    // the menu item's x-canonical-type
+};
+
+constexpr ActionInfo action_table[] = {
+    {HEADER_ACTION_KEY, nullptr, STATE_HEADER, ENABLED_ALWAYS, ACTIVATE_NONE, nullptr, "", ""},
+    {LOCATION_ACTION_KEY, nullptr, STATE_LOCATION, ENABLED_WHEN_VALID, ACTIVATE_TOGGLE, N_("Location detection"), "",
+     "com.canonical.indicator.switch"},
+    {GPS_ACTION_KEY, nullptr, STATE_GPS, ENABLED_WHEN_VALID, ACTIVATE_TOGGLE, nullptr, "", ""},
+    {SETTINGS_ACTION_KEY, "s", STATE_NONE, ENABLED_ALWAYS, ACTIVATE_SETTINGS, N_("Location settings…"), "::location",
+     ""}};
+
+// The switches' states are only ever one of these two,
+// so reuse them instead of allocating a new one per update
+GVariant* boolean_variant(bool b)
+{
+    static GVariant* const variants[2] = {g_variant_ref_sink(g_variant_new_boolean(false)),
+                                          g_variant_ref_sink(g_variant_new_boolean(true))};
+    return variants[b];
+}
+
+void on_settings_activated(GSimpleAction* simple G_GNUC_UNUSED, GVariant* parameter, gpointer user_data G_GNUC_UNUSED)
+{
+    const char* key = g_variant_get_string(parameter, nullptr);
+    gchar* uri = g_strdup_printf("settings:///%s", key);
+    UriDispatcher::get().dispatch(uri);
+    g_free(uri);
+}
+}
 
 Phone::Phone(const std::shared_ptr<Controller>& controller_, const std::shared_ptr<GSimpleActionGroup>& action_group_)
     : controller(controller_)
     , action_group(action_group_)
 {
+    create_update_source();
+    check_locale();
     create_menu();
 
     auto on_gps = [this](bool enabled)
     {
-        update_gps_enabled_action();
-        update_header();
+        confirm_toggle(gps_toggle, enabled);
+        schedule_update(DIRTY_GPS | DIRTY_HEADER);
     };
     controller_connections.push_back(controller->gps_enabled().changed().connect(on_gps));
 
     auto on_loc = [this](bool enabled)
     {
-        update_detection_enabled_action();
-        update_header();
+        confirm_toggle(location_toggle, enabled);
+        schedule_update(DIRTY_LOCATION | DIRTY_HEADER);
     };
     controller_connections.push_back(controller->location_service_enabled().changed().connect(on_loc));
 
+    shown_active = controller->location_service_active().get();
     auto on_loc_active = [this](bool active)
     {
-        update_header();
+        on_location_service_active_changed(active);
     };
     controller_connections.push_back(controller->location_service_active().changed().connect(on_loc_active));
 
     auto on_valid = [this](bool valid)
     {
-        update_actions_enabled();
+        schedule_update(DIRTY_ENABLED | DIRTY_HEADER);
     };
     controller_connections.push_back(controller->is_valid().changed().connect(on_valid));
 
-    /* create the actions & add them to the group */
-    std::array<GSimpleAction*, 4> actions = {
-        create_root_action(), create_detection_enabled_action(), create_gps_enabled_action(), create_settings_action()};
-    for (auto a : actions)
+    // the same header is accurate once the controller's confirmed it
+    auto on_seeded = [this](bool)
     {
-        g_action_map_add_action(G_ACTION_MAP(action_group.get()), G_ACTION(a));
-        g_object_unref(a);
-    }
+        schedule_update(DIRTY_HEADER);
+    };
+    controller_connections.push_back(controller->is_seeded().changed().connect(on_seeded));
 
+    auto on_set_failed = [this](Controller::Setting setting)
+    {
+        rollback_toggle(setting == Controller::Setting::GPS_ENABLED ? gps_toggle : location_toggle);
+    };
+    controller_connections.push_back(controller->set_failed().connect(on_set_failed));
+
+    create_actions();
     update_actions_enabled();
 }
 
 Phone::~Phone()
 {
+    g_source_destroy(update_source);
+    g_source_unref(update_source);
+
+    if (active_hold_tag != 0)
+    {
+        g_source_remove(active_hold_tag);
+    }
+
+    cancel_toggle_timeout(location_toggle);
+    cancel_toggle_timeout(gps_toggle);
+
+    for (auto& action : actions)
+    {
+        g_clear_object(&action);
+    }
+
+    clear_header_cache();
+}
+
+/***
+****  Update scheduling
+****
+****  A single controller change (e.g. the location service appearing)
+****  can fire several property signals back-to-back. Rather than push
+****  each one to the bus, we mark what's dirty and publish it all once
+****  when the main loop goes idle.
+***/
+
+namespace
+{
+unsigned int count_bits(unsigned int flags)
+{
+    unsigned int n = 0;
+    for (; flags != 0; flags &= flags - 1)
+    {
+        ++n;
+    }
+    return n;
+}
+}
+
+void Phone::schedule_update(unsigned int flags)
+{
+    stats.requested += count_bits(flags);
+
+    dirty_flags |= flags;
+
+    if (is_suspended())
+    {
+        stats.deferred += count_bits(flags);
+    }
+    else if (!update_scheduled)
+    {
+        set_update_scheduled(true);
+    }
+}
+
+bool Phone::is_suspended() const
+{
+    return suspended || display_off;
+}
+
+void Phone::set_suspended(bool suspended_)
+{
+    const bool was_suspended = is_suspended();
+    suspended = suspended_;
+    on_suspended_changed(was_suspended);
+}
+
+void Phone::set_display_state(const std::shared_ptr<DisplayState>& display_state_)
+{
+    display_state_connections.clear();
+    display_state = display_state_;
+
+    auto on_display = [this](bool is_on)
+    {
+        const bool was_suspended = is_suspended();
+        display_off = !is_on;
+        on_suspended_changed(was_suspended);
+    };
+    display_state_connections.push_back(display_state->is_on().changed().connect(on_display));
+    on_display(display_state->is_on().get());
+}
+
+void Phone::on_suspended_changed(bool was_suspended)
+{
+    const bool now_suspended = is_suspended();
+    if (was_suspended == now_suspended)
+    {
+        return;
+    }
+
+    g_debug("%s publishing phone state", now_suspended ? "suspending" : "resuming");
+
+    if (now_suspended)
+    {
+        set_update_scheduled(false);
+    }
+    else
+    {
+        refresh();
+    }
+}
+
+void Phone::refresh()
+{
+    set_update_scheduled(false);
+    flush_updates();
+}
+
+// One idle-priority source is made up front and armed with a ready time
+// whenever an update is scheduled, so that scheduling doesn't allocate.
+
+void Phone::create_update_source()
+{
+    static GSourceFuncs funcs = {nullptr, nullptr, dispatch_update_source, nullptr};
+
+    update_source = g_source_new(&funcs, sizeof(GSource));
+    g_source_set_priority(update_source, G_PRIORITY_DEFAULT_IDLE);
+    g_source_set_callback(update_source, on_update_idle, this, nullptr);
+    g_source_set_ready_time(update_source, -1);
+    g_source_attach(update_source, nullptr);
+}
+
+void Phone::set_update_scheduled(bool scheduled)
+{
+    if (update_scheduled != scheduled)
+    {
+        update_scheduled = scheduled;
+        g_source_set_ready_time(update_source, scheduled ? 0 : -1);
+    }
+}
+
+gboolean Phone::dispatch_update_source(GSource* source, GSourceFunc callback, gpointer user_data)
+{
+    g_source_set_ready_time(source, -1);
+    return callback(user_data);
+}
+
+gboolean Phone::on_update_idle(gpointer gself)
+{
+    WakeupAudit::attribute(WakeupAudit::SOURCE_UPDATE);
+    auto self = static_cast<Phone*>(gself);
+    self->update_scheduled = false;
+    self->flush_updates();
+    return G_SOURCE_CONTINUE;
+}
+
+void Phone::flush_updates()
+{
+    const auto dirty = dirty_flags;
+    dirty_flags = 0;
+
+    if (dirty != 0)
+    {
+        ++stats.flushes;
+        stats.published += count_bits(dirty & ~DIRTY_HEADER);
+    }
+
+    if (dirty & DIRTY_ENABLED)
+    {
+        update_actions_enabled();
+    }
+
+    if (dirty & DIRTY_LOCATION)
+    {
+        update_detection_enabled_action();
+    }
+
+    if (dirty & DIRTY_GPS)
+    {
+        update_gps_enabled_action();
+    }
+
+    if (dirty & DIRTY_HEADER)
+    {
+        check_locale();
+        if (update_header())
+        {
+            ++stats.published;
+        }
+    }
 }
 
 /***
@@ -103,10 +369,75 @@ bool Phone::location_service_active() const
         return false;
     }
 
-    return controller->location_service_active().get();
+    return shown_active;
+}
+
+/***
+****  Active hold-down
+****
+****  The location service is active whenever any app has a session open,
+****  so apps that poll flip it on and off every few seconds. We show
+****  'active' right away but wait for a quiet period before showing 'idle'.
+***/
+
+void Phone::set_active_hold_msec(unsigned int msec)
+{
+    active_hold_msec = msec;
+
+    // if we're holding and no longer should be, let it go now
+    if ((active_hold_msec == 0) && (active_hold_tag != 0))
+    {
+        g_source_remove(active_hold_tag);
+        active_hold_tag = 0;
+        set_shown_active(false);
+    }
+}
+
+void Phone::on_location_service_active_changed(bool active)
+{
+    if (active && (active_hold_tag != 0))
+    {
+        // back before the hold expired, so the header never went idle
+        g_source_remove(active_hold_tag);
+        active_hold_tag = 0;
+        ++stats.flaps_absorbed;
+    }
+    else if (active || (active_hold_msec == 0))
+    {
+        set_shown_active(active);
+    }
+    else if (active_hold_tag == 0)
+    {
+        active_hold_tag = g_timeout_add(active_hold_msec, on_active_hold_timeout, this);
+    }
+}
+
+gboolean Phone::on_active_hold_timeout(gpointer gself)
+{
+    WakeupAudit::attribute(WakeupAudit::SOURCE_TIMER);
+    auto self = static_cast<Phone*>(gself);
+    self->active_hold_tag = 0;
+    self->set_shown_active(false);
+    return G_SOURCE_REMOVE;
+}
+
+void Phone::set_shown_active(bool active)
+{
+    shown_active = active;
+    schedule_update(DIRTY_HEADER);
+}
+
+Phone::HeaderState Phone::header_state() const
+{
+    if (!should_be_visible())
+    {
+        return HEADER_HIDDEN;
+    }
+
+    return location_service_active() ? HEADER_ACTIVE : HEADER_IDLE;
 }
 
-GVariant* Phone::action_state_for_root() const
+GVariant* Phone::create_header_variant(HeaderState state)
 {
     GVariantBuilder builder;
     g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
@@ -117,7 +448,7 @@ GVariant* Phone::action_state_for_root() const
     const char* title = _("Location");
     g_variant_builder_add(&builder, "{sv}", "title", g_variant_new_string(title));
 
-    gboolean visible = should_be_visible();
+    gboolean visible = state != HEADER_HIDDEN;
     g_variant_builder_add(&builder, "{sv}", "visible", g_variant_new_boolean(visible));
 
     GIcon* icon;
@@ -125,7 +456,7 @@ GVariant* Phone::action_state_for_root() const
     {
         icon = g_themed_icon_new_with_default_fallbacks("location-disabled");
     }
-    else if (location_service_active())
+    else if (state == HEADER_ACTIVE)
     {
         icon = g_themed_icon_new_with_default_fallbacks("location-active");
     }
@@ -141,135 +472,310 @@ GVariant* Phone::action_state_for_root() const
     }
     g_object_unref(icon);
 
-    return g_variant_builder_end(&builder);
+    return g_variant_ref_sink(g_variant_builder_end(&builder));
 }
 
-#define HEADER_ACTION_KEY PROFILE_NAME "-header"
+void Phone::clear_header_cache()
+{
+    for (auto& v : header_cache)
+    {
+        g_clear_pointer(&v, g_variant_unref);
+    }
+
+    // the old variants are gone, so forget which one we published
+    published_header = nullptr;
+}
 
-GSimpleAction* Phone::create_root_action()
+// The header's and the menu's strings are translated, so when the
+// locale changes, forget the cached headers and relabel the menu.
+void Phone::check_locale()
 {
-    return g_simple_action_new_stateful(HEADER_ACTION_KEY, nullptr, action_state_for_root());
+    const char* locale = setlocale(LC_MESSAGES, nullptr);
+    if (locale == nullptr)
+    {
+        locale = "";
+    }
+    if (header_cache_locale == locale)
+    {
+        return;
+    }
+
+    clear_header_cache();
+    header_cache_locale = locale;
+    if (submenu)
+    {
+        rebuild_submenu();
+    }
 }
 
-void Phone::update_header()
+GVariant* Phone::action_state_for_root()
 {
-    g_action_group_change_action_state(G_ACTION_GROUP(action_group.get()), HEADER_ACTION_KEY, action_state_for_root());
+    Metrics::ScopedTimer timer(Metrics::STAGE_HEADER_BUILD);
+
+    auto& cached = header_cache[header_state()];
+    if (cached == nullptr)
+    {
+        cached = create_header_variant(header_state());
+    }
+
+    return cached;
+}
+
+bool Phone::update_header()
+{
+    auto state = action_state_for_root();
+
+    // once the action group is on the bus, a header from real values is accurate.
+    // Cached ones don't count, even when they turn out to be right.
+    auto& timeline = StartupTimeline::get();
+    if (controller->is_valid().get() && !controller->is_seeded().get() &&
+        (timeline.elapsed(StartupTimeline::EXPORTED) >= 0))
+    {
+        timeline.mark(StartupTimeline::FIRST_ACCURATE_HEADER);
+    }
+
+    // don't re-emit a header that the shell already has
+    if (state == published_header)
+    {
+        ++stats.headers_skipped;
+        TRACE2(update_header, int(header_state()), 0);
+        return false;
+    }
+
+    published_header = state;
+    {
+        Metrics::ScopedTimer timer(Metrics::STAGE_EXPORT_EMIT);
+        g_simple_action_set_state(actions[ACTION_HEADER], state);
+    }
+    TRACE2(update_header, int(header_state()), 1);
+    return true;
 }
 
 void Phone::update_actions_enabled()
 {
-    const auto map = G_ACTION_MAP(action_group.get());
     const bool is_valid = controller->is_valid().get();
-    std::array<const char*, 2> keys = {LOCATION_ACTION_KEY, GPS_ACTION_KEY};
-    for (const auto& key : keys)
+    for (int i = 0; i < N_ACTIONS; ++i)
     {
-        g_simple_action_set_enabled(G_SIMPLE_ACTION(g_action_map_lookup_action(map, key)), is_valid);
+        if (action_table[i].enabled == ENABLED_WHEN_VALID)
+        {
+            g_simple_action_set_enabled(actions[i], is_valid);
+        }
     }
-
-    update_header();
 }
 
 /***
 ****
 ***/
 
-GVariant* Phone::action_state_for_location_detection()
+/***
+****  Toggles
+****
+****  In optimistic mode the switch moves as soon as it's activated, and
+****  moves back if the controller doesn't confirm the change in time.
+***/
+
+#define TOGGLE_TIMEOUT_SEC 5
+
+void Phone::set_optimistic_toggles(bool optimistic_)
 {
-    return g_variant_new_boolean(controller->location_service_enabled().get());
+    optimistic = optimistic_;
 }
 
-void Phone::on_detection_location_activated(GSimpleAction* action, GVariant* parameter G_GNUC_UNUSED, gpointer gself)
+bool Phone::toggle_value(const Toggle& toggle, bool actual) const
 {
-    GVariant* state = g_action_get_state(G_ACTION(action));
-    static_cast<Phone*>(gself)->controller->set_location_service_enabled(!g_variant_get_boolean(state));
-    g_variant_unref(state);
+    return toggle.pending ? toggle.requested : actual;
 }
 
-GSimpleAction* Phone::create_detection_enabled_action()
+void Phone::on_toggle_activated(Toggle& toggle, GSimpleAction* action)
 {
-    GSimpleAction* action;
+    controller->request_activation();
 
-    action = g_simple_action_new_stateful(LOCATION_ACTION_KEY, nullptr, action_state_for_location_detection());
+    GVariant* state = g_action_get_state(G_ACTION(action));
+    toggle.requested = !g_variant_get_boolean(state);
+    toggle.activated_at = g_get_monotonic_time();
+    g_variant_unref(state);
 
-    g_signal_connect(action, "activate", G_CALLBACK(on_detection_location_activated), this);
+    if (optimistic)
+    {
+        // If the controller already has the requested value, e.g. on a quick
+        // double tap, no change is coming to confirm it; don't wait for one
+        const bool actual = toggle.dirty_flag == DIRTY_LOCATION ? controller->location_service_enabled().get()
+                                                                : controller->gps_enabled().get();
+        toggle.pending = toggle.requested != actual;
+        cancel_toggle_timeout(toggle);
+        if (toggle.pending)
+        {
+            toggle.timeout_tag = g_timeout_add_seconds(TOGGLE_TIMEOUT_SEC, on_toggle_timeout, &toggle);
+        }
+
+        // don't wait for the idle flush; the point is immediate feedback
+        if (toggle.dirty_flag == DIRTY_LOCATION)
+        {
+            update_detection_enabled_action();
+        }
+        else
+        {
+            update_gps_enabled_action();
+        }
+    }
 
-    return action;
+    if (toggle.dirty_flag == DIRTY_LOCATION)
+    {
+        controller->set_location_service_enabled(toggle.requested);
+    }
+    else
+    {
+        controller->set_gps_enabled(toggle.requested);
+    }
 }
 
-void Phone::update_detection_enabled_action()
+void Phone::on_toggle_feedback(Toggle& toggle, bool shown)
 {
-    GAction* action = g_action_map_lookup_action(G_ACTION_MAP(action_group.get()), LOCATION_ACTION_KEY);
-    g_simple_action_set_state(G_SIMPLE_ACTION(action), action_state_for_location_detection());
+    if ((toggle.activated_at != 0) && (shown == toggle.requested))
+    {
+        stats.last_toggle_latency_usec = g_get_monotonic_time() - toggle.activated_at;
+        toggle.activated_at = 0;
+        g_debug("toggle feedback after %" G_GINT64_FORMAT " usec (%s)", stats.last_toggle_latency_usec,
+                optimistic ? "optimistic" : "confirmed");
+    }
 }
 
-/***
-****
-***/
-
-GVariant* Phone::action_state_for_gps_detection()
+void Phone::confirm_toggle(Toggle& toggle, bool actual)
 {
-    return g_variant_new_boolean(controller->gps_enabled().get());
+    if (toggle.pending && (actual == toggle.requested))
+    {
+        toggle.pending = false;
+        cancel_toggle_timeout(toggle);
+    }
 }
 
-void Phone::on_detection_gps_activated(GSimpleAction* action, GVariant* parameter G_GNUC_UNUSED, gpointer gself)
+void Phone::rollback_toggle(Toggle& toggle)
 {
-    GVariant* state = g_action_get_state(G_ACTION(action));
-    static_cast<Phone*>(gself)->controller->set_gps_enabled(!g_variant_get_boolean(state));
-    g_variant_unref(state);
+    toggle.activated_at = 0;
+
+    if (toggle.pending)
+    {
+        g_debug("rolling back optimistic toggle");
+        toggle.pending = false;
+        cancel_toggle_timeout(toggle);
+        ++stats.toggle_rollbacks;
+        schedule_update(toggle.dirty_flag);
+    }
 }
 
-GSimpleAction* Phone::create_gps_enabled_action()
+void Phone::cancel_toggle_timeout(Toggle& toggle)
 {
-    GSimpleAction* action;
+    if (toggle.timeout_tag != 0)
+    {
+        g_source_remove(toggle.timeout_tag);
+        toggle.timeout_tag = 0;
+    }
+}
 
-    action = g_simple_action_new_stateful(GPS_ACTION_KEY, nullptr, action_state_for_gps_detection());
+gboolean Phone::on_toggle_timeout(gpointer gtoggle)
+{
+    WakeupAudit::attribute(WakeupAudit::SOURCE_TIMER);
+    auto toggle = static_cast<Toggle*>(gtoggle);
+    toggle->timeout_tag = 0;
+    toggle->phone->rollback_toggle(*toggle);
+    return G_SOURCE_REMOVE;
+}
 
-    g_signal_connect(action, "activate", G_CALLBACK(on_detection_gps_activated), this);
+/***
+****
+***/
 
-    return action;
+GVariant* Phone::action_state_for_location_detection()
+{
+    return boolean_variant(toggle_value(location_toggle, controller->location_service_enabled().get()));
 }
 
-void Phone::update_gps_enabled_action()
+void Phone::update_detection_enabled_action()
 {
-    GAction* action = g_action_map_lookup_action(G_ACTION_MAP(action_group.get()), GPS_ACTION_KEY);
-    g_simple_action_set_state(G_SIMPLE_ACTION(action), action_state_for_gps_detection());
+    {
+        Metrics::ScopedTimer timer(Metrics::STAGE_EXPORT_EMIT);
+        g_simple_action_set_state(actions[ACTION_LOCATION], action_state_for_location_detection());
+    }
+    on_toggle_feedback(location_toggle, toggle_value(location_toggle, controller->location_service_enabled().get()));
 }
 
 /***
 ****
 ***/
 
-#define SETTINGS_ACTION_KEY "settings"
-
-namespace
+GVariant* Phone::action_state_for_gps_detection()
 {
-void on_uri_dispatched(const gchar* uri, gboolean success, gpointer user_data G_GNUC_UNUSED)
+    return boolean_variant(toggle_value(gps_toggle, controller->gps_enabled().get()));
+}
+
+void Phone::update_gps_enabled_action()
 {
-    if (!success)
     {
-        g_warning("Unable to activate '%s'", uri);
+        Metrics::ScopedTimer timer(Metrics::STAGE_EXPORT_EMIT);
+        g_simple_action_set_state(actions[ACTION_GPS], action_state_for_gps_detection());
     }
+    on_toggle_feedback(gps_toggle, toggle_value(gps_toggle, controller->gps_enabled().get()));
 }
 
-void on_settings_activated(GSimpleAction* simple G_GNUC_UNUSED, GVariant* parameter, gpointer user_data G_GNUC_UNUSED)
+/***
+****
+***/
+
+void Phone::on_toggle_action_activated(GSimpleAction* action, GVariant* parameter G_GNUC_UNUSED, gpointer gself)
 {
-    const char* key = g_variant_get_string(parameter, nullptr);
-    gchar* uri = g_strdup_printf("settings:///%s", key);
-    g_debug("%s calling url_dispatch_send '%s'", G_STRLOC, uri);
-    url_dispatch_send(uri, on_uri_dispatched, nullptr);
-    g_free(uri);
-}
+    WakeupAudit::attribute(WakeupAudit::SOURCE_SESSION_BUS_CALL);
+    auto self = static_cast<Phone*>(gself);
+    auto& toggle = action == self->actions[ACTION_LOCATION] ? self->location_toggle : self->gps_toggle;
+    self->on_toggle_activated(toggle, action);
 }
 
-GSimpleAction* Phone::create_settings_action()
+void Phone::create_actions()
 {
-    GSimpleAction* action;
+    static_assert(G_N_ELEMENTS(action_table) == N_ACTIONS, "action_table doesn't match ActionIndex");
+    static_assert(action_table[ACTION_HEADER].state == STATE_HEADER, "action_table is out of order");
+    static_assert(action_table[ACTION_LOCATION].state == STATE_LOCATION, "action_table is out of order");
+    static_assert(action_table[ACTION_GPS].state == STATE_GPS, "action_table is out of order");
 
-    action = g_simple_action_new(SETTINGS_ACTION_KEY, G_VARIANT_TYPE_STRING);
-
-    g_signal_connect(action, "activate", G_CALLBACK(on_settings_activated), nullptr);
-
-    return action;
+    const auto map = G_ACTION_MAP(action_group.get());
+    for (int i = 0; i < N_ACTIONS; ++i)
+    {
+        const auto& info = action_table[i];
+
+        GVariant* state = nullptr;
+        switch (info.state)
+        {
+            case STATE_HEADER:
+                published_header = state = action_state_for_root();
+                break;
+            case STATE_LOCATION:
+                state = action_state_for_location_detection();
+                break;
+            case STATE_GPS:
+                state = action_state_for_gps_detection();
+                break;
+            case STATE_NONE:
+                break;
+        }
+
+        auto parameter_type = info.parameter_type ? G_VARIANT_TYPE(info.parameter_type) : nullptr;
+        GSimpleAction* action = state ? g_simple_action_new_stateful(info.key, parameter_type, state)
+                                      : g_simple_action_new(info.key, parameter_type);
+
+        switch (info.activation)
+        {
+            case ACTIVATE_TOGGLE:
+                g_signal_connect(action, "activate", G_CALLBACK(on_toggle_action_activated), this);
+                break;
+            case ACTIVATE_SETTINGS:
+                g_signal_connect(action, "activate", G_CALLBACK(on_settings_activated), nullptr);
+                break;
+            case ACTIVATE_NONE:
+                break;
+        }
+
+        g_action_map_add_action(map, G_ACTION(action));
+        actions[i] = action;
+    }
 }
 
 /***
@@ -297,14 +803,27 @@ void Phone::create_menu()
     g_object_unref(header);
 }
 
-void Phone::rebuild_submenu()
+MenuSpec Phone::create_submenu_spec() const
 {
-    g_menu_remove_all(submenu.get());
+    MenuSpec spec;
+
+    for (const auto& info : action_table)
+    {
+        if (info.menu_label != nullptr)
+        {
+            auto action = std::string("indicator.") + info.key + info.menu_target;
+            spec.push_back({_(info.menu_label), action, info.menu_type});
+        }
+    }
 
-    GMenuItem* location = g_menu_item_new(_("Location detection"), "indicator." LOCATION_ACTION_KEY);
-    g_menu_item_set_attribute(location, "x-canonical-type", "s", "com.canonical.indicator.switch");
-    g_menu_append_item(submenu.get(), location);
-    g_object_unref(location);
+    return spec;
+}
 
-    g_menu_append(submenu.get(), _("Location settings…"), "indicator." SETTINGS_ACTION_KEY "::location");
+void Phone::rebuild_submenu()
+{
+    // only touch the items that changed, so clients don't re-fetch the rest
+    auto spec = create_submenu_spec();
+    const auto diff = MenuDiff::apply(submenu.get(), submenu_spec, spec);
+    stats.menu_edits += diff.removed + diff.inserted;
+    submenu_spec.swap(spec);
 }
@@ -19,13 +19,17 @@
 
 #pragma once
 
+#include <array>
 #include <memory>
+#include <string>
 #include <vector>
 
 #include <glib.h>
 #include <gio/gio.h>
 
 #include "controller.h"
+#include "display-state.h"
+#include "menu-diff.h"
 
 class Phone
 {
@@ -37,6 +41,46 @@ public:
         return menu;
     }
 
+    /// Bookkeeping for the update scheduler.
+    /// requested - published is the number of emissions saved by coalescing.
+    struct UpdateStats
+    {
+        unsigned int requested{0};            // action updates requested by controller changes
+        unsigned int published{0};            // action updates actually pushed to the action group
+        unsigned int flushes{0};              // idle passes that published at least one update
+        unsigned int headers_skipped{0};      // header updates dropped because the state was unchanged
+        unsigned int toggle_rollbacks{0};     // optimistic toggles reverted after a failure or timeout
+        unsigned int deferred{0};             // action updates held back while suspended
+        unsigned int flaps_absorbed{0};       // active -> idle -> active flips that never reached the header
+        unsigned int menu_edits{0};           // submenu items removed or inserted by rebuilds
+        gint64 last_toggle_latency_usec{-1};  // time from a toggle's activation to the switch moving
+    };
+    const UpdateStats& update_stats() const
+    {
+        return stats;
+    }
+
+    /// If true, the location & GPS switches flip as soon as they're
+    /// activated instead of waiting for the controller to confirm it.
+    void set_optimistic_toggles(bool optimistic);
+
+    /// While suspended, controller changes only mark state as dirty;
+    /// nothing is computed or published until we're resumed or refreshed.
+    /// Used when no client is listening.
+    void set_suspended(bool suspended);
+
+    /// Publish any pending changes now, e.g. because a client is asking for them
+    void refresh();
+
+    /// Also suspend while this says the display is off,
+    /// then publish the latest state in one pass when it comes back on.
+    void set_display_state(const std::shared_ptr<DisplayState>& display_state);
+
+    /// Show the location-active icon as soon as the service is active, but
+    /// only go back to idle once it's been inactive for 'msec'. Apps that
+    /// poll for a position would otherwise make the icon flap.
+    void set_active_hold_msec(unsigned int msec);
+
 protected:
     std::shared_ptr<Controller> controller;
     std::vector<core::ScopedConnection> controller_connections;
@@ -44,35 +88,118 @@ protected:
 private:
     std::shared_ptr<GMenu> menu;
     std::shared_ptr<GMenu> submenu;
+    MenuSpec submenu_spec;  // what's in 'submenu' right now
     std::shared_ptr<GSimpleActionGroup> action_group;
 
+private:
+    enum DirtyFlags
+    {
+        DIRTY_HEADER = (1 << 0),
+        DIRTY_LOCATION = (1 << 1),
+        DIRTY_GPS = (1 << 2),
+        DIRTY_ENABLED = (1 << 3)
+    };
+    unsigned int dirty_flags{0};
+    GSource* update_source{nullptr};
+    bool update_scheduled{false};
+    bool suspended{false};    // no one's subscribed
+    bool display_off{false};  // no one can see us
+    std::shared_ptr<DisplayState> display_state;
+    std::vector<core::ScopedConnection> display_state_connections;
+    bool is_suspended() const;
+    void on_suspended_changed(bool was_suspended);
+    UpdateStats stats;
+    void schedule_update(unsigned int flags);
+    void flush_updates();
+    void create_update_source();
+    void set_update_scheduled(bool scheduled);
+    static gboolean dispatch_update_source(GSource*, GSourceFunc, gpointer);
+    static gboolean on_update_idle(gpointer);
+
+private:
+    unsigned int active_hold_msec{0};
+    bool shown_active{false};  // location_service_active, as shown in the header
+    guint active_hold_tag{0};
+    void on_location_service_active_changed(bool active);
+    void set_shown_active(bool active);
+    static gboolean on_active_hold_timeout(gpointer gself);
+
 private:
     void create_menu();
     void rebuild_submenu();
+    MenuSpec create_submenu_spec() const;
 
 private:
     bool should_be_visible() const;
     bool location_service_active() const;
-    GVariant* action_state_for_root() const;
-    GSimpleAction* create_root_action();
-    void update_header();
+    GVariant* action_state_for_root();
+    bool update_header();
     void update_actions_enabled();
 
+private:
+    // The header only depends on these derived states,
+    // so we serialize each one once and reuse it.
+    enum HeaderState
+    {
+        HEADER_HIDDEN,
+        HEADER_IDLE,
+        HEADER_ACTIVE,
+        N_HEADER_STATES
+    };
+    HeaderState header_state() const;
+    static GVariant* create_header_variant(HeaderState);
+    void clear_header_cache();
+    std::array<GVariant*, N_HEADER_STATES> header_cache{};
+    void check_locale();
+    std::string header_cache_locale;
+    GVariant* published_header{nullptr};
+
+private:
+    struct Toggle
+    {
+        Toggle(Phone* phone_, unsigned int dirty_flag_)
+            : phone(phone_)
+            , dirty_flag(dirty_flag_)
+        {
+        }
+
+        Phone* const phone;
+        const unsigned int dirty_flag;
+        bool pending{false};     // showing the requested value until the controller confirms it
+        bool requested{false};   // the value most recently requested by the user
+        gint64 activated_at{0};  // when the user asked, or 0 if the switch has already moved
+        guint timeout_tag{0};
+    };
+    bool optimistic{false};
+    Toggle location_toggle{this, DIRTY_LOCATION};
+    Toggle gps_toggle{this, DIRTY_GPS};
+    bool toggle_value(const Toggle& toggle, bool actual) const;
+    void on_toggle_activated(Toggle& toggle, GSimpleAction* action);
+    void on_toggle_feedback(Toggle& toggle, bool shown);
+    void confirm_toggle(Toggle& toggle, bool actual);
+    void rollback_toggle(Toggle& toggle);
+    void cancel_toggle_timeout(Toggle& toggle);
+    static gboolean on_toggle_timeout(gpointer gtoggle);
+
 private:
     GVariant* action_state_for_location_detection();
-    GSimpleAction* create_detection_enabled_action();
     void update_detection_enabled_action();
-    static void on_detection_location_activated(GSimpleAction*, GVariant*, gpointer);
 
 private:
     GVariant* action_state_for_gps_detection();
-    GSimpleAction* create_gps_enabled_action();
     void update_gps_enabled_action();
-    static void on_detection_gps_activated(GSimpleAction*, GVariant*, gpointer);
 
 private:
-    GSimpleAction* create_settings_action();
-
-private:
-    GSimpleAction* create_licence_action();
+    // indices into phone.cc's action table
+    enum ActionIndex
+    {
+        ACTION_HEADER,
+        ACTION_LOCATION,
+        ACTION_GPS,
+        ACTION_SETTINGS,
+        N_ACTIONS
+    };
+    std::array<GSimpleAction*, N_ACTIONS> actions{};  // created from the table; we hold a ref to each
+    void create_actions();
+    static void on_toggle_action_activated(GSimpleAction*, GVariant*, gpointer);
 };
@@ -0,0 +1,211 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+#include <type_traits>
+
+#include <glib.h>
+
+#include <core/property.h>
+
+/***
+****  Decoders
+****
+****  A decoder turns a property's GVariant into the value we mirror.
+****  It names the GVariant type it accepts so that RemoteProperty can
+****  check it at compile time and reject mistyped values at run time.
+***/
+
+namespace remote_property_detail
+{
+constexpr bool contains(const char* chars, char c)
+{
+    return (*chars != '\0') && ((*chars == c) || contains(chars + 1, c));
+}
+
+// true if 'type' is a single basic GVariant type, e.g. "b" or "s"
+constexpr bool is_basic_type(const char* type)
+{
+    return (type[0] != '\0') && (type[1] == '\0') && contains("bynqiuxtdsog", type[0]);
+}
+}
+
+template <typename T>
+struct DefaultDecoder
+{
+    static_assert(sizeof(T) == 0, "no default GVariant decoder for this type");
+};
+
+template <>
+struct DefaultDecoder<bool>
+{
+    typedef bool value_type;
+    static constexpr const char* type_string()
+    {
+        return "b";
+    }
+    static bool decode(GVariant* variant)
+    {
+        return g_variant_get_boolean(variant);
+    }
+};
+
+template <>
+struct DefaultDecoder<gint32>
+{
+    typedef gint32 value_type;
+    static constexpr const char* type_string()
+    {
+        return "i";
+    }
+    static gint32 decode(GVariant* variant)
+    {
+        return g_variant_get_int32(variant);
+    }
+};
+
+template <>
+struct DefaultDecoder<guint32>
+{
+    typedef guint32 value_type;
+    static constexpr const char* type_string()
+    {
+        return "u";
+    }
+    static guint32 decode(GVariant* variant)
+    {
+        return g_variant_get_uint32(variant);
+    }
+};
+
+template <typename T>
+struct EnumValue
+{
+    const char* name;
+    T value;
+};
+
+/**
+ * Decodes a string property by looking it up in Traits::values(),
+ * comparing against the string borrowed from the GVariant rather
+ * than a copy. Unknown strings decode to Traits::fallback().
+ */
+template <typename Traits>
+struct EnumDecoder
+{
+    typedef typename Traits::value_type value_type;
+    static constexpr const char* type_string()
+    {
+        return "s";
+    }
+    static value_type decode(GVariant* variant)
+    {
+        const gchar* str = g_variant_get_string(variant, nullptr);
+        for (const auto& entry : Traits::values())
+        {
+            if (!g_strcmp0(str, entry.name))
+            {
+                return entry.value;
+            }
+        }
+        return Traits::fallback();
+    }
+};
+
+/***
+****  RemoteProperty
+***/
+
+/**
+ * The parts of a RemoteProperty that don't depend on its type, so that
+ * properties of different types can be handled in one table.
+ */
+class RemotePropertyBase
+{
+public:
+    explicit RemotePropertyBase(const char* name)
+        : m_name(name)
+    {
+    }
+    virtual ~RemotePropertyBase() = default;
+
+    /// The D-Bus property name
+    const char* name() const
+    {
+        return m_name;
+    }
+
+    /// True if 'variant' has the type that this property's decoder expects
+    virtual bool accepts(GVariant* variant) const = 0;
+
+    /// Decodes 'variant' and sets the property to it.
+    /// Returns false, leaving the property alone, if it has the wrong type.
+    virtual bool update(GVariant* variant) = 0;
+
+    /// The current value as an int, for logging & tracepoints
+    virtual int as_int() const = 0;
+
+private:
+    const char* const m_name;
+};
+
+/**
+ * A core::Property<T> that mirrors a D-Bus property.
+ *
+ * Decoder::type_string() is the GVariant type it accepts, and Decoder::decode()
+ * turns a value of that type into a T without allocating.
+ */
+template <typename T, typename Decoder = DefaultDecoder<T>>
+class RemoteProperty : public RemotePropertyBase, public core::Property<T>
+{
+    static_assert(std::is_same<T, typename Decoder::value_type>::value, "Decoder doesn't produce a T");
+    static_assert(remote_property_detail::is_basic_type(Decoder::type_string()),
+                  "Decoder::type_string() must be a basic GVariant type");
+
+public:
+    explicit RemoteProperty(const char* name, const T& initial = T{})
+        : RemotePropertyBase(name)
+        , core::Property<T>(initial)
+    {
+    }
+
+    bool accepts(GVariant* variant) const override
+    {
+        return g_variant_is_of_type(variant, G_VARIANT_TYPE(Decoder::type_string()));
+    }
+
+    bool update(GVariant* variant) override
+    {
+        if (!accepts(variant))
+        {
+            g_warning("%s: expected a '%s', got a '%s'", name(), Decoder::type_string(),
+                      g_variant_get_type_string(variant));
+            return false;
+        }
+
+        this->set(Decoder::decode(variant));
+        return true;
+    }
+
+    int as_int() const override
+    {
+        return int(this->get());
+    }
+};
@@ -21,26 +21,75 @@
 #include <gio/gio.h>
 
 #include "dbus-shared.h"
+#include "metrics.h"
 #include "service.h"
+#include "startup-timeline.h"
+#include "wakeup-audit.h"
 
 /**
 ***
 **/
 
-Service::Service(const std::shared_ptr<Controller>& controller)
-    : action_group(g_simple_action_group_new(), GObjectDeleter())
-    , phone_profile(controller, action_group)
+Service::Service(const std::shared_ptr<Controller>& controller_)
+    : controller(controller_)
+    , action_group(g_simple_action_group_new(), GObjectDeleter())
+    , phone_profile(controller_, action_group)
     , name_lost_callback(nullptr)
     , name_lost_user_data(0)
+    , idle_exit_sec(0)
+    , idle_exit_callback(nullptr)
+    , idle_exit_user_data(0)
+    , idle_exit_tag(0)
     , action_group_export_id(0)
+    , debug_registration_id(0)
     , bus_own_id(0)
 {
+    // no one's listening yet, so don't bother publishing phone state.
+    //
+    // Only org.gtk.Menus subscribers count as listeners. org.gtk.Actions
+    // has no Start/End, so a client that only watches the action group
+    // (e.g. a bare GDBusActionGroup) gets current states when it calls
+    // Describe or DescribeAll, but isn't sent Changed signals while no one
+    // has the menu open. Action-only consumers aren't supported; the shell
+    // always subscribes to the menu as well.
+    phone_profile.set_suspended(true);
+
+    // someone's looking at the menu, so make sure it shows real values
+    auto on_subscribers = [this](unsigned int n_subscribers)
+    {
+        phone_profile.set_suspended(n_subscribers == 0);
+
+        if (n_subscribers > 0)
+        {
+            controller->request_activation();
+        }
+
+        update_idle_exit_timer();
+    };
+    connections.push_back(menu_subscribers.count().changed().connect(on_subscribers));
+
+    // someone's asking for the actions' states, so make sure they're current
+    auto on_actions_described = [this]()
+    {
+        phone_profile.refresh();
+    };
+    connections.push_back(menu_subscribers.actions_described().connect(on_actions_described));
+
     bus_own_id = g_bus_own_name(G_BUS_TYPE_SESSION, INDICATOR_BUS_NAME, G_BUS_NAME_OWNER_FLAGS_NONE, on_bus_acquired,
-                                nullptr, on_name_lost, this, nullptr);
+                                on_name_acquired, on_name_lost, this, nullptr);
 }
 
 Service::~Service()
 {
+    // unexport() drops the subscriber count, which mustn't rearm the idle-exit timer
+    connections.clear();
+
+    if (idle_exit_tag != 0)
+    {
+        g_source_remove(idle_exit_tag);
+        idle_exit_tag = 0;
+    }
+
     if (connection)
     {
         unexport();
@@ -58,10 +107,83 @@ void Service::set_name_lost_callback(name_lost_callback_func callback, void* use
     name_lost_user_data = user_data;
 }
 
+/***
+****  Idle exit
+***/
+
+void Service::set_idle_exit(unsigned int seconds, idle_exit_callback_func callback, void* user_data)
+{
+    idle_exit_sec = seconds;
+    idle_exit_callback = callback;
+    idle_exit_user_data = user_data;
+
+    update_idle_exit_timer();
+}
+
+void Service::update_idle_exit_timer()
+{
+    const bool want_timer = (idle_exit_sec > 0) && (bus_own_id != 0) && (menu_subscribers.count().get() == 0);
+
+    if (!want_timer && (idle_exit_tag != 0))
+    {
+        g_source_remove(idle_exit_tag);
+        idle_exit_tag = 0;
+    }
+    else if (want_timer && (idle_exit_tag == 0))
+    {
+        idle_exit_tag = g_timeout_add_seconds(idle_exit_sec, on_idle_exit_timeout, this);
+    }
+}
+
+gboolean Service::on_idle_exit_timeout(gpointer gself)
+{
+    WakeupAudit::attribute(WakeupAudit::SOURCE_TIMER);
+    auto self = static_cast<Service*>(gself);
+
+    // if we're still waiting to hear back from the location service,
+    // give it another period rather than dropping the answer on the floor
+    if (self->controller->is_busy())
+    {
+        g_debug("%s: controller is busy; not exiting yet", G_STRLOC);
+        return G_SOURCE_CONTINUE;
+    }
+
+    self->idle_exit_tag = 0;
+    self->on_idle_exit();
+    return G_SOURCE_REMOVE;
+}
+
+void Service::on_idle_exit()
+{
+    g_message("No menu subscribers for %u seconds; exiting", idle_exit_sec);
+
+    // let the caller persist state before we release the name, so that
+    // an instance activated right after us starts from up-to-date values
+    if (idle_exit_callback != nullptr)
+    {
+        (idle_exit_callback)(this, idle_exit_user_data);
+    }
+
+    if (connection)
+    {
+        unexport();
+        connection.reset();
+    }
+
+    g_bus_unown_name(bus_own_id);
+    bus_own_id = 0;
+}
+
+/***
+****
+***/
+
 void Service::unexport()
 {
     g_return_if_fail(connection);
 
+    menu_subscribers.stop();
+
     // unexport the menu(s)
     for (auto& id : exported_menus)
     {
@@ -69,6 +191,13 @@ void Service::unexport()
     }
     exported_menus.clear();
 
+    // unexport the debug interface
+    if (debug_registration_id != 0)
+    {
+        g_dbus_connection_unregister_object(connection.get(), debug_registration_id);
+        debug_registration_id = 0;
+    }
+
     // unexport the action group
     if (action_group_export_id != 0)
     {
@@ -77,10 +206,121 @@ void Service::unexport()
     }
 }
 
+/***
+****  Debug interface
+****
+****  Lets us see where the time goes on a running system:
+****
+****    gdbus call --session --dest com.canonical.indicator.location \
+****               --object-path /com/canonical/indicator/location \
+****               --method com.canonical.indicator.location.Debug.GetHistograms
+***/
+
+#define DEBUG_IFACE_NAME INDICATOR_BUS_NAME ".Debug"
+
+namespace
+{
+const char* const debug_introspection_xml =
+    "<node>"
+    "  <interface name='" DEBUG_IFACE_NAME "'>"
+    "    <!-- stage name to (count, total ns, max ns, counts of [2^i, 2^(i+1)) ns buckets) -->"
+    "    <method name='GetHistograms'>"
+    "      <arg type='a{s(tttat)}' name='histograms' direction='out'/>"
+    "    </method>"
+    "    <!-- counter name to count -->"
+    "    <method name='GetCounters'>"
+    "      <arg type='a{st}' name='counters' direction='out'/>"
+    "    </method>"
+    "    <!-- with --audit-wakeups, source name to wakeups since the last report -->"
+    "    <method name='GetWakeups'>"
+    "      <arg type='a{st}' name='wakeups' direction='out'/>"
+    "    </method>"
+    "    <method name='Reset'/>"
+    "    <!-- milestone name to usec since the process started -->"
+    "    <method name='GetStartupTimeline'>"
+    "      <arg type='a{sx}' name='timeline' direction='out'/>"
+    "    </method>"
+    "  </interface>"
+    "</node>";
+}
+
+void Service::register_debug_interface(GDBusConnection* conn)
+{
+    static GDBusNodeInfo* node_info = nullptr;
+    if (node_info == nullptr)
+    {
+        node_info = g_dbus_node_info_new_for_xml(debug_introspection_xml, nullptr);
+    }
+
+    static const GDBusInterfaceVTable vtable = {on_debug_method_call, nullptr, nullptr};
+
+    GError* error = nullptr;
+    const auto id = g_dbus_connection_register_object(conn, INDICATOR_OBJECT_PATH, node_info->interfaces[0], &vtable,
+                                                      this, nullptr, &error);
+    if (error != nullptr)
+    {
+        g_warning("Unable to export debug interface: %s", error->message);
+        g_clear_error(&error);
+    }
+    else
+    {
+        debug_registration_id = id;
+    }
+}
+
+void Service::on_debug_method_call(GDBusConnection*,
+                                   const gchar* /*sender*/,
+                                   const gchar* /*object_path*/,
+                                   const gchar* /*interface_name*/,
+                                   const gchar* method_name,
+                                   GVariant* /*parameters*/,
+                                   GDBusMethodInvocation* invocation,
+                                   gpointer /*gself*/)
+{
+    WakeupAudit::attribute(WakeupAudit::SOURCE_SESSION_BUS_CALL);
+    auto& metrics = Metrics::get();
+
+    if (!g_strcmp0(method_name, "GetHistograms"))
+    {
+        g_dbus_method_invocation_return_value(invocation, g_variant_new("(@a{s(tttat)})", metrics.create_variant()));
+    }
+    else if (!g_strcmp0(method_name, "GetCounters"))
+    {
+        g_dbus_method_invocation_return_value(invocation, g_variant_new("(@a{st})", metrics.create_counters_variant()));
+    }
+    else if (!g_strcmp0(method_name, "GetWakeups"))
+    {
+        g_dbus_method_invocation_return_value(invocation,
+                                              g_variant_new("(@a{st})", WakeupAudit::get().create_variant()));
+    }
+    else if (!g_strcmp0(method_name, "Reset"))
+    {
+        metrics.reset();
+        g_dbus_method_invocation_return_value(invocation, nullptr);
+    }
+    else if (!g_strcmp0(method_name, "GetStartupTimeline"))
+    {
+        g_dbus_method_invocation_return_value(invocation,
+                                              g_variant_new("(@a{sx})", StartupTimeline::get().create_variant()));
+    }
+    else
+    {
+        g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+                                              "Unknown method '%s'", method_name);
+    }
+}
+
 /***
 ****  GDBus
 ***/
 
+void Service::on_name_acquired(GDBusConnection* conn, const char* name, gpointer /*gself*/)
+{
+    g_debug("%s::%s: %s %p", G_STRLOC, G_STRFUNC, name, conn);
+
+    StartupTimeline::get().mark(StartupTimeline::NAME_OWNED);
+}
+
 void Service::on_name_lost(GDBusConnection* conn, const char* name, gpointer gself)
 {
     g_debug("%s::%s: %s %p", G_STRLOC, G_STRFUNC, name, conn);
@@ -105,6 +345,9 @@ void Service::on_bus_acquired(GDBusConnection* conn, const char* name)
 {
     g_debug("%s::%s: %s %p", G_STRLOC, G_STRFUNC, name, conn);
 
+    auto& timeline = StartupTimeline::get();
+    timeline.mark(StartupTimeline::SESSION_BUS_ACQUIRED);
+
     this->connection.reset(G_DBUS_CONNECTION(g_object_ref(conn)));
 
     GError* error = nullptr;
@@ -125,6 +368,8 @@ void Service::on_bus_acquired(GDBusConnection* conn, const char* name)
 
     /* export the menu(s) */
 
+    menu_subscribers.start(conn, INDICATOR_OBJECT_PATH);
+
     struct
     {
         std::shared_ptr<GMenu> menu;
@@ -144,4 +389,15 @@ void Service::on_bus_acquired(GDBusConnection* conn, const char* name)
             exported_menus.insert(export_id);
         }
     }
+
+    /* export the debug interface */
+
+    register_debug_interface(conn);
+
+    timeline.mark(StartupTimeline::EXPORTED);
+    if (controller->is_valid().get() && !controller->is_seeded().get())
+    {
+        // the real values arrived before we were exported
+        timeline.mark(StartupTimeline::FIRST_ACCURATE_HEADER);
+    }
 }
@@ -21,8 +21,10 @@
 
 #include <memory>
 #include <set>
+#include <vector>
 
 #include "controller.h"
+#include "menu-subscribers.h"
 #include "phone.h"
 #include "utils.h"  // GObjectDeleter
 
@@ -32,10 +34,23 @@ public:
     explicit Service(const std::shared_ptr<Controller>& controller);
     virtual ~Service();
 
+    Phone& get_phone_profile()
+    {
+        return phone_profile;
+    }
+
+    const MenuSubscribers& get_menu_subscribers() const
+    {
+        return menu_subscribers;
+    }
+
 private:
+    std::shared_ptr<Controller> controller;
     std::shared_ptr<GSimpleActionGroup> action_group;
     std::unique_ptr<GDBusConnection, GObjectDeleter> connection;
     Phone phone_profile;
+    MenuSubscribers menu_subscribers;
+    std::vector<core::ScopedConnection> connections;
 
 public:
     typedef void (*name_lost_callback_func)(Service*, void* user_data);
@@ -45,15 +60,44 @@ private:
     name_lost_callback_func name_lost_callback;
     void* name_lost_user_data;
 
+public:
+    /// After 'seconds' with no menu subscribers and no backend calls in flight,
+    /// call 'callback' so the caller can save its state, then unexport and
+    /// release our bus name. D-Bus activation brings up a new instance on demand.
+    typedef void (*idle_exit_callback_func)(Service*, void* user_data);
+    void set_idle_exit(unsigned int seconds, idle_exit_callback_func callback, void* user_data);
+
+private:
+    unsigned int idle_exit_sec;
+    idle_exit_callback_func idle_exit_callback;
+    void* idle_exit_user_data;
+    unsigned int idle_exit_tag;
+    void update_idle_exit_timer();
+    void on_idle_exit();
+    static gboolean on_idle_exit_timeout(gpointer gself);
+
 private:
     unsigned int action_group_export_id;
     std::set<unsigned int> exported_menus;
     void unexport();
 
+private:  // debug interface
+    unsigned int debug_registration_id;
+    void register_debug_interface(GDBusConnection*);
+    static void on_debug_method_call(GDBusConnection*,
+                                     const gchar* sender,
+                                     const gchar* object_path,
+                                     const gchar* interface_name,
+                                     const gchar* method_name,
+                                     GVariant* parameters,
+                                     GDBusMethodInvocation*,
+                                     gpointer gself);
+
 private:  // DBus callbacks
     unsigned int bus_own_id;
     void on_name_lost(GDBusConnection*, const char*);
     void on_bus_acquired(GDBusConnection*, const char*);
+    static void on_name_acquired(GDBusConnection*, const char*, gpointer);
     static void on_name_lost(GDBusConnection*, const char*, gpointer);
     static void on_bus_acquired(GDBusConnection*, const char*, gpointer);
 };
@@ -0,0 +1,199 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+
+#include <glib.h>
+
+/**
+ * Hands values over from one thread to another thread's GMainContext,
+ * in order and without locking or allocating.
+ *
+ * push() copies the value into a fixed ring of N slots and arms a
+ * persistent GSource on the consumer's context, which passes each value
+ * to the consumer callback. If the consumer falls so far behind that the
+ * ring fills up, the producer keeps its latest value aside, replacing it
+ * on each push, until the consumer has made room and woken the producer's
+ * context to retry. So values may be coalesced under load, but they always
+ * arrive in order and the latest one always arrives.
+ *
+ * push() must only be called from the thread that runs the producer's
+ * context. The handoff must be destroyed on the consumer's thread once
+ * the producer has stopped; it's safe for the consumer callback to do it.
+ */
+template <typename T, std::size_t N>
+class SnapshotHandoff
+{
+public:
+    typedef std::function<void(const T&)> Consumer;
+
+    SnapshotHandoff(GMainContext* producer_context, GMainContext* consumer_context, Consumer&& consumer)
+        : m_consumer(std::move(consumer))
+        , m_consume_source(create_source(consumer_context, on_consume_ready, this))
+        , m_retry_source(create_source(producer_context, on_retry_ready, this))
+    {
+    }
+
+    ~SnapshotHandoff()
+    {
+        if (m_destroyed != nullptr)
+        {
+            *m_destroyed = true;
+        }
+
+        for (auto source : {m_retry_source, m_consume_source})
+        {
+            g_source_destroy(source);
+            g_source_unref(source);
+        }
+    }
+
+    SnapshotHandoff(const SnapshotHandoff&) = delete;
+    SnapshotHandoff& operator=(const SnapshotHandoff&) = delete;
+
+    // called from the producer's thread
+    void push(const T& value)
+    {
+        m_pending = value;
+        m_has_pending = true;
+        flush_pending();
+    }
+
+    // true if everything pushed has been consumed; safe to call from any thread
+    bool is_empty() const
+    {
+        return !m_has_pending && (m_read.load() == m_write.load());
+    }
+
+private:
+    static GSource* create_source(GMainContext* context, GSourceFunc func, gpointer self)
+    {
+        static GSourceFuncs funcs = {nullptr, nullptr, dispatch_source, nullptr};
+
+        auto source = g_source_new(&funcs, sizeof(GSource));
+        g_source_set_priority(source, G_PRIORITY_DEFAULT);
+        g_source_set_callback(source, func, self, nullptr);
+        g_source_set_ready_time(source, -1);
+        g_source_attach(source, context);
+        return source;
+    }
+
+    // g_source_set_ready_time() is safe to call from any thread and wakes the source's context
+    static gboolean dispatch_source(GSource* source, GSourceFunc callback, gpointer user_data)
+    {
+        g_source_set_ready_time(source, -1);
+        return callback(user_data);
+    }
+
+    /***
+    ****  Producer side
+    ***/
+
+    void flush_pending()
+    {
+        const auto write = m_write.load(std::memory_order_relaxed);
+        if (write - m_read.load() == N)
+        {
+            // full. Ask the consumer to wake us when it's made room, then look
+            // again in case it made some before it could see that we asked.
+            m_stalled = true;
+            if (write - m_read.load() == N)
+            {
+                return;
+            }
+            m_stalled = false;
+        }
+
+        m_slots[write % N] = m_pending;
+        m_write.store(write + 1, std::memory_order_release);
+        m_has_pending = false;
+
+        if (!m_consume_armed.exchange(true))
+        {
+            g_source_set_ready_time(m_consume_source, 0);
+        }
+    }
+
+    static gboolean on_retry_ready(gpointer gself)
+    {
+        auto self = static_cast<SnapshotHandoff*>(gself);
+        if (self->m_has_pending)
+        {
+            self->flush_pending();
+        }
+        return G_SOURCE_CONTINUE;
+    }
+
+    /***
+    ****  Consumer side
+    ***/
+
+    static gboolean on_consume_ready(gpointer gself)
+    {
+        static_cast<SnapshotHandoff*>(gself)->consume();
+        return G_SOURCE_CONTINUE;
+    }
+
+    void consume()
+    {
+        // disarm before looking, so that anything we miss arms it again
+        m_consume_armed = false;
+
+        bool destroyed = false;
+        m_destroyed = &destroyed;
+
+        auto read = m_read.load(std::memory_order_relaxed);
+        const auto write = m_write.load(std::memory_order_acquire);
+        while (read != write)
+        {
+            m_consumer(m_slots[read % N]);
+            if (destroyed)
+            {
+                return;
+            }
+            m_read = ++read;
+        }
+        m_destroyed = nullptr;
+
+        if (m_stalled.exchange(false))
+        {
+            g_source_set_ready_time(m_retry_source, 0);
+        }
+    }
+
+    const Consumer m_consumer;
+    GSource* const m_consume_source;
+    GSource* const m_retry_source;
+
+    std::array<T, N> m_slots{};
+    std::atomic<std::size_t> m_write{0};  // written by the producer
+    std::atomic<std::size_t> m_read{0};   // written by the consumer
+
+    T m_pending{};  // only touched by the producer
+    std::atomic<bool> m_has_pending{false};
+    std::atomic<bool> m_stalled{false};        // the producer is waiting for room
+    std::atomic<bool> m_consume_armed{false};  // m_consume_source is ready or running
+
+    bool* m_destroyed{nullptr};  // set while the consumer callback runs
+};
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#include "startup-timeline.h"
+
+StartupTimeline& StartupTimeline::get()
+{
+    static StartupTimeline timeline;
+    return timeline;
+}
+
+const char* StartupTimeline::milestone_name(Milestone milestone)
+{
+    static const char* const names[N_MILESTONES] = {"process-start",    "locale-init",      "session-bus-acquired",
+                                                     "name-owned",       "exported",         "system-bus-ready",
+                                                     "service-appeared", "first-reply",      "first-accurate-header"};
+
+    return names[milestone];
+}
+
+void StartupTimeline::mark(Milestone milestone)
+{
+    // only the first one counts
+    gint64 unreached = 0;
+    if (!m_times[milestone].compare_exchange_strong(unreached, g_get_monotonic_time()))
+    {
+        return;
+    }
+
+    if (milestone == FIRST_ACCURATE_HEADER)
+    {
+        g_message("startup timeline (usec): %s", to_string().c_str());
+    }
+}
+
+gint64 StartupTimeline::elapsed(Milestone milestone) const
+{
+    const gint64 time = m_times[milestone].load();
+    if (time == 0)
+    {
+        return -1;
+    }
+
+    // if main() didn't mark the start, e.g. in tests, use the earliest we have
+    gint64 start = m_times[PROCESS_START].load();
+    if (start == 0)
+    {
+        for (const auto& t : m_times)
+        {
+            const gint64 value = t.load();
+            if ((value != 0) && ((start == 0) || (value < start)))
+            {
+                start = value;
+            }
+        }
+    }
+
+    return time - start;
+}
+
+std::string StartupTimeline::to_string() const
+{
+    std::string str;
+
+    for (int i = 0; i < N_MILESTONES; ++i)
+    {
+        const auto usec = elapsed(Milestone(i));
+        if (usec >= 0)
+        {
+            if (!str.empty())
+            {
+                str += ' ';
+            }
+            str += milestone_name(Milestone(i));
+            str += '=';
+            str += std::to_string(usec);
+        }
+    }
+
+    return str;
+}
+
+GVariant* StartupTimeline::create_variant() const
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{sx}"));
+
+    for (int i = 0; i < N_MILESTONES; ++i)
+    {
+        const auto usec = elapsed(Milestone(i));
+        if (usec >= 0)
+        {
+            g_variant_builder_add(&builder, "{sx}", milestone_name(Milestone(i)), usec);
+        }
+    }
+
+    return g_variant_builder_end(&builder);
+}
+
+void StartupTimeline::reset()
+{
+    for (auto& t : m_times)
+    {
+        t.store(0);
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <string>
+
+#include <glib.h>
+
+/**
+ * When each step of startup happened, so that we can see where the
+ * time goes before the indicator is showing accurate information.
+ *
+ * Only the first time each milestone is reached is kept. When the
+ * last one is reached, the timeline is logged in a single line.
+ * It's also available from Service's Debug interface.
+ *
+ * Milestones may be marked from any thread.
+ */
+class StartupTimeline
+{
+public:
+    enum Milestone
+    {
+        PROCESS_START,
+        LOCALE_INIT,
+        SESSION_BUS_ACQUIRED,
+        NAME_OWNED,
+        EXPORTED,
+        SYSTEM_BUS_READY,
+        SERVICE_APPEARED,
+        FIRST_REPLY,
+        FIRST_ACCURATE_HEADER,
+        N_MILESTONES
+    };
+
+    static StartupTimeline& get();
+    static const char* milestone_name(Milestone milestone);
+
+    void mark(Milestone milestone);
+
+    /// usec from process start to 'milestone', or -1 if it hasn't happened
+    gint64 elapsed(Milestone milestone) const;
+
+    /// "process-start=0 locale-init=112 ...", in usec; unreached milestones are skipped
+    std::string to_string() const;
+
+    /// Returns a floating a{sx} of the reached milestones' elapsed times
+    GVariant* create_variant() const;
+
+    void reset();
+
+private:
+    std::array<std::atomic<gint64>, N_MILESTONES> m_times{};  // monotonic time, or 0 if not reached
+};
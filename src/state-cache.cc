@@ -0,0 +1,171 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#include <cstring>  // memcmp()
+
+#include "state-cache.h"
+#include "wakeup-audit.h"
+
+#define FLUSH_DELAY_SEC 2
+
+namespace
+{
+// The whole file. Changing it means bumping VERSION.
+struct FileLayout
+{
+    char magic[4];
+    guint8 version;
+    guint8 flags;
+    guint8 reserved[2];
+};
+static_assert(sizeof(FileLayout) == 8, "the state file's layout is fixed");
+
+const char MAGIC[4] = {'I', 'L', 'O', 'C'};
+constexpr guint8 VERSION{1};
+
+enum
+{
+    FLAG_LOC_ENABLED = (1 << 0),
+    FLAG_GPS_ENABLED = (1 << 1),
+    FLAG_UNUSED = (1 << 2)  // was "active"; ignored if an older build wrote it
+};
+
+// only compares what we save
+bool operator==(const Controller::Snapshot& a, const Controller::Snapshot& b)
+{
+    return (a.location_service_enabled == b.location_service_enabled) && (a.gps_enabled == b.gps_enabled);
+}
+}
+
+/***
+****
+***/
+
+StateCache::StateCache(const std::string& filename)
+    : m_filename(filename)
+{
+}
+
+StateCache::~StateCache()
+{
+    flush();
+}
+
+std::string StateCache::default_filename()
+{
+    gchar* filename = g_build_filename(g_get_user_cache_dir(), "indicator-location", "state", nullptr);
+    std::string ret{filename};
+    g_free(filename);
+    return ret;
+}
+
+bool StateCache::load(Controller::Snapshot& setme)
+{
+    GError* error = nullptr;
+    GMappedFile* file = g_mapped_file_new(m_filename.c_str(), false, &error);
+    if (file == nullptr)
+    {
+        g_debug("no cached state: %s", error->message);
+        g_error_free(error);
+        return false;
+    }
+
+    bool loaded = false;
+    const auto layout = reinterpret_cast<const FileLayout*>(g_mapped_file_get_contents(file));
+    if ((g_mapped_file_get_length(file) != sizeof(FileLayout)) || memcmp(layout->magic, MAGIC, sizeof(MAGIC)) ||
+        (layout->version != VERSION))
+    {
+        g_warning("ignoring unrecognized state file '%s'", m_filename.c_str());
+    }
+    else
+    {
+        setme.location_service_enabled = (layout->flags & FLAG_LOC_ENABLED) != 0;
+        setme.gps_enabled = (layout->flags & FLAG_GPS_ENABLED) != 0;
+        setme.location_service_active = false;
+        loaded = true;
+
+        // no need to write it back out unchanged
+        m_written = setme;
+        m_have_written = true;
+    }
+
+    g_mapped_file_unref(file);
+    return loaded;
+}
+
+void StateCache::save(const Controller::Snapshot& snapshot)
+{
+    m_pending = snapshot;
+    m_have_pending = true;
+
+    if (m_flush_tag == 0)
+    {
+        m_flush_tag = g_timeout_add_seconds(FLUSH_DELAY_SEC, on_flush_timeout, this);
+    }
+}
+
+gboolean StateCache::on_flush_timeout(gpointer gself)
+{
+    WakeupAudit::attribute(WakeupAudit::SOURCE_TIMER);
+    auto self = static_cast<StateCache*>(gself);
+    self->m_flush_tag = 0;
+    self->flush();
+    return G_SOURCE_REMOVE;
+}
+
+void StateCache::flush()
+{
+    if (m_flush_tag != 0)
+    {
+        g_source_remove(m_flush_tag);
+        m_flush_tag = 0;
+    }
+
+    if (!m_have_pending)
+    {
+        return;
+    }
+    m_have_pending = false;
+
+    if (m_have_written && (m_pending == m_written))
+    {
+        return;
+    }
+
+    FileLayout layout{};
+    memcpy(layout.magic, MAGIC, sizeof(MAGIC));
+    layout.version = VERSION;
+    layout.flags = (m_pending.location_service_enabled ? FLAG_LOC_ENABLED : 0) |
+                   (m_pending.gps_enabled ? FLAG_GPS_ENABLED : 0);
+
+    // g_file_set_contents() writes a temporary file and renames it over the old one
+    gchar* dirname = g_path_get_dirname(m_filename.c_str());
+    g_mkdir_with_parents(dirname, 0700);
+    g_free(dirname);
+    GError* error = nullptr;
+    if (!g_file_set_contents(m_filename.c_str(), reinterpret_cast<const gchar*>(&layout), sizeof(layout), &error))
+    {
+        g_warning("Unable to save state to '%s': %s", m_filename.c_str(), error->message);
+        g_error_free(error);
+        return;
+    }
+
+    m_written = m_pending;
+    m_have_written = true;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+#include <string>
+
+#include <glib.h>
+
+#include "controller.h"  // Controller::Snapshot
+
+/**
+ * Keeps the last known location-service settings in a small file so that
+ * the next launch can show them before the service has answered.
+ *
+ * Only the durable settings are kept. Whether the service is active
+ * says nothing about the next boot, so it always loads as false:
+ * showing the location-active icon while nothing is using location
+ * would be worse than showing it a moment late.
+ *
+ * Saves are throttled and written atomically, so a crash mid-write
+ * leaves either the old state or the new one.
+ */
+class StateCache
+{
+public:
+    explicit StateCache(const std::string& filename);
+    ~StateCache();  // flushes
+
+    /// $XDG_CACHE_HOME/indicator-location/state
+    static std::string default_filename();
+
+    /// Returns false if there's no usable state file
+    bool load(Controller::Snapshot& setme);
+
+    /// Writes 'snapshot' soon, replacing any save that's still waiting
+    void save(const Controller::Snapshot& snapshot);
+
+    /// Writes any waiting save now
+    void flush();
+
+    StateCache(const StateCache&) = delete;
+    StateCache& operator=(const StateCache&) = delete;
+
+private:
+    static gboolean on_flush_timeout(gpointer gself);
+
+    const std::string m_filename;
+    Controller::Snapshot m_pending{};
+    Controller::Snapshot m_written{};
+    bool m_have_pending{false};
+    bool m_have_written{false};
+    guint m_flush_tag{0};
+};
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+/**
+ * Static (USDT) tracepoints for bpftrace, perf, systemtap, etc.
+ * See tools/indicator-location-latency.bt for a consumer.
+ *
+ * Built with -Denable_tracepoints=ON, each TRACEn() is a single nop
+ * in the text section. Otherwise it, and its arguments, compile away.
+ *
+ * Probes in the "indicator_location" provider:
+ *
+ *   name_appeared(appearance)
+ *   name_vanished(appearance)
+ *   get_issued(key)                 key is "*" for GetAll
+ *   get_reply(key, success)
+ *   property_changed(key, type)     every PropertiesChanged key, mirrored or not;
+ *                                   type is the value's GVariant type string
+ *   property_updated(key, value)    a mirrored key was decoded; value is the boolean,
+ *                                   or State == "active", or -1 if it had the wrong type
+ *   set_issued(key, value)
+ *   set_done(key, success)
+ *   update_header(state, published) state is a Phone::HeaderState
+ */
+
+#ifdef ENABLE_TRACEPOINTS
+
+#include <sys/sdt.h>
+
+#define TRACE1(name, a) DTRACE_PROBE1(indicator_location, name, a)
+#define TRACE2(name, a, b) DTRACE_PROBE2(indicator_location, name, a, b)
+
+#else
+
+#define TRACE1(name, a) \
+    do                  \
+    {                   \
+    } while (0)
+#define TRACE2(name, a, b) \
+    do                     \
+    {                      \
+    } while (0)
+
+#endif
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#include "unity-screen-display-state.h"
+#include "wakeup-audit.h"
+
+#include <gio/gio.h>
+
+#define SCREEN_BUS_NAME "com.canonical.Unity.Screen"
+#define SCREEN_OBJECT_PATH "/com/canonical/Unity/Screen"
+#define SCREEN_IFACE_NAME "com.canonical.Unity.Screen"
+
+// DisplayPowerStateChange's 'state' arg
+#define DISPLAY_POWER_STATE_OFF 0
+
+/***
+****
+***/
+
+class UnityScreenDisplayState::Impl
+{
+public:
+    Impl()
+        : m_cancellable(g_cancellable_new())
+    {
+        g_bus_get(G_BUS_TYPE_SYSTEM, m_cancellable, on_system_bus_ready, this);
+    }
+
+    ~Impl()
+    {
+        g_cancellable_cancel(m_cancellable);
+        g_clear_object(&m_cancellable);
+
+        if (m_name_watch_tag != 0)
+        {
+            g_bus_unwatch_name(m_name_watch_tag);
+        }
+
+        if (m_signal_tag != 0)
+        {
+            g_dbus_connection_signal_unsubscribe(m_system_bus, m_signal_tag);
+        }
+
+        g_clear_object(&m_system_bus);
+    }
+
+    const core::Property<bool>& is_on() const
+    {
+        return m_is_on;
+    }
+
+private:
+    static void on_system_bus_ready(GObject* /*source*/, GAsyncResult* res, gpointer gself)
+    {
+        GError* error = nullptr;
+        auto system_bus = g_bus_get_finish(res, &error);
+
+        if (error != nullptr)
+        {
+            if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            {
+                g_warning("Couldn't get system bus: %s", error->message);
+            }
+            g_error_free(error);
+        }
+        else
+        {
+            static_cast<Impl*>(gself)->on_system_bus_ready(system_bus);
+        }
+    }
+
+    void on_system_bus_ready(GDBusConnection* system_bus)
+    {
+        m_system_bus = system_bus;
+
+        m_signal_tag = g_dbus_connection_signal_subscribe(
+            m_system_bus, SCREEN_BUS_NAME, SCREEN_IFACE_NAME, "DisplayPowerStateChange", SCREEN_OBJECT_PATH, nullptr,
+            G_DBUS_SIGNAL_FLAGS_NONE, on_display_power_state_change, this, nullptr);
+
+        m_name_watch_tag = g_bus_watch_name_on_connection(m_system_bus, SCREEN_BUS_NAME, G_BUS_NAME_WATCHER_FLAGS_NONE,
+                                                          on_screen_appeared, on_screen_vanished, this, nullptr);
+    }
+
+    // the display may already be off, e.g. if we or the screen service just
+    // (re)started, and there won't be a signal until it changes; so ask
+    static void on_screen_appeared(GDBusConnection*, const gchar* /*name*/, const gchar* /*owner*/, gpointer gself)
+    {
+        WakeupAudit::attribute(WakeupAudit::SOURCE_SYSTEM_BUS_SIGNAL);
+        auto self = static_cast<Impl*>(gself);
+        self->m_signals_at_query = self->m_signals;
+        g_dbus_connection_call(self->m_system_bus, SCREEN_BUS_NAME, SCREEN_OBJECT_PATH, SCREEN_IFACE_NAME,
+                               "getDisplayPowerState", nullptr, G_VARIANT_TYPE("(i)"), G_DBUS_CALL_FLAGS_NONE,
+                               -1,  // use default timeout
+                               self->m_cancellable, on_power_state_reply, self);
+    }
+
+    static void on_power_state_reply(GObject* system_bus, GAsyncResult* res, gpointer gself)
+    {
+        GError* error = nullptr;
+        auto reply = g_dbus_connection_call_finish(G_DBUS_CONNECTION(system_bus), res, &error);
+        if (error != nullptr)
+        {
+            // if it can't tell us, keep assuming the display's on
+            if (!g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+            {
+                g_debug("Couldn't get the display power state: %s", error->message);
+            }
+            g_error_free(error);
+            return;
+        }
+
+        WakeupAudit::attribute(WakeupAudit::SOURCE_SYSTEM_BUS_SIGNAL);
+        auto self = static_cast<Impl*>(gself);
+        gint32 state = 0;
+        g_variant_get(reply, "(i)", &state);
+        g_variant_unref(reply);
+        g_debug("display power state is %d", int(state));
+
+        // a signal that's arrived since we asked is newer than this
+        if (self->m_signals == self->m_signals_at_query)
+        {
+            self->m_is_on.set(state != DISPLAY_POWER_STATE_OFF);
+        }
+    }
+
+    static void on_display_power_state_change(GDBusConnection*,
+                                              const gchar* /*sender_name*/,
+                                              const gchar* /*object_path*/,
+                                              const gchar* /*interface_name*/,
+                                              const gchar* /*signal_name*/,
+                                              GVariant* parameters,
+                                              gpointer gself)
+    {
+        WakeupAudit::attribute(WakeupAudit::SOURCE_SYSTEM_BUS_SIGNAL);
+        gint32 state = 0;
+        gint32 reason = 0;
+        if (!g_variant_is_of_type(parameters, G_VARIANT_TYPE("(ii)")))
+        {
+            g_warning("Unexpected DisplayPowerStateChange args '%s'", g_variant_get_type_string(parameters));
+            return;
+        }
+        g_variant_get(parameters, "(ii)", &state, &reason);
+        g_debug("display power state changed to %d (reason %d)", int(state), int(reason));
+
+        auto self = static_cast<Impl*>(gself);
+        ++self->m_signals;
+        self->m_is_on.set(state != DISPLAY_POWER_STATE_OFF);
+    }
+
+    // don't stay 'off' forever just because the screen service went away
+    static void on_screen_vanished(GDBusConnection*, const gchar* /*name*/, gpointer gself)
+    {
+        WakeupAudit::attribute(WakeupAudit::SOURCE_SYSTEM_BUS_SIGNAL);
+        static_cast<Impl*>(gself)->m_is_on.set(true);
+    }
+
+    core::Property<bool> m_is_on{true};
+    GCancellable* m_cancellable{nullptr};
+    GDBusConnection* m_system_bus{nullptr};
+    guint m_signal_tag{0};
+    guint m_name_watch_tag{0};
+    unsigned int m_signals{0};           // DisplayPowerStateChanges received
+    unsigned int m_signals_at_query{0};  // m_signals when we last asked for the state
+};
+
+/***
+****
+***/
+
+UnityScreenDisplayState::UnityScreenDisplayState()
+    : impl{new Impl{}}
+{
+}
+
+UnityScreenDisplayState::~UnityScreenDisplayState()
+{
+}
+
+const core::Property<bool>& UnityScreenDisplayState::is_on() const
+{
+    return impl->is_on();
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+#include "display-state.h"  // parent class
+
+#include <memory>  // std::unique_ptr
+
+/**
+ * Follows the display's power state from the
+ * com.canonical.Unity.Screen DisplayPowerStateChange signal on the system bus.
+ *
+ * Whenever the screen service appears, we ask it for the current state
+ * with getDisplayPowerState, since there's no signal until it changes.
+ * Until it answers, or if it can't, we assume the display is on; and
+ * again if the screen service goes away.
+ */
+class UnityScreenDisplayState : public DisplayState
+{
+public:
+    UnityScreenDisplayState();
+    virtual ~UnityScreenDisplayState();
+
+    const core::Property<bool>& is_on() const override;
+
+    UnityScreenDisplayState(const UnityScreenDisplayState&) = delete;
+    UnityScreenDisplayState& operator=(const UnityScreenDisplayState&) = delete;
+
+private:
+    class Impl;
+    std::unique_ptr<Impl> impl;
+};
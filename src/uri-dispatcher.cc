@@ -0,0 +1,95 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#include <dlfcn.h>
+
+#include <type_traits>
+
+#include <glib.h>
+
+#include <url-dispatcher.h>  // only for the types; the library is dlopen()ed
+
+#include "uri-dispatcher.h"
+
+#define URL_DISPATCHER_SONAME "liburl-dispatcher.so.1"
+
+namespace
+{
+void on_uri_dispatched(const char* uri, int success, void* /*user_data*/)
+{
+    if (!success)
+    {
+        g_warning("Unable to activate '%s'", uri);
+    }
+}
+}
+
+UriDispatcher& UriDispatcher::get()
+{
+    static UriDispatcher dispatcher;
+    return dispatcher;
+}
+
+bool UriDispatcher::is_loaded() const
+{
+    return m_send != nullptr;
+}
+
+bool UriDispatcher::load()
+{
+    if (is_loaded() || m_load_failed)
+    {
+        return is_loaded();
+    }
+
+    // kept open for the life of the process
+    void* handle = dlopen(URL_DISPATCHER_SONAME, RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr)
+    {
+        g_warning("Unable to load %s: %s", URL_DISPATCHER_SONAME, dlerror());
+        m_load_failed = true;
+        return false;
+    }
+
+    static_assert(std::is_same<decltype(&url_dispatch_send), SendFunc>::value,
+                  "url_dispatch_send()'s signature has changed");
+    m_send = reinterpret_cast<SendFunc>(dlsym(handle, "url_dispatch_send"));
+    if (m_send == nullptr)
+    {
+        g_warning("Unable to find url_dispatch_send in %s: %s", URL_DISPATCHER_SONAME, dlerror());
+        dlclose(handle);
+        m_load_failed = true;
+        return false;
+    }
+
+    g_debug("loaded %s", URL_DISPATCHER_SONAME);
+    return true;
+}
+
+bool UriDispatcher::dispatch(const char* uri)
+{
+    if (!load())
+    {
+        return false;
+    }
+
+    g_debug("%s calling url_dispatch_send '%s'", G_STRLOC, uri);
+    m_send(uri, on_uri_dispatched, nullptr);
+    return true;
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+/**
+ * Hands URIs to url-dispatcher.
+ *
+ * Opening the settings is the only thing that needs url-dispatcher,
+ * and it rarely happens, so liburl-dispatcher (and everything it pulls
+ * in) isn't loaded until the first dispatch() instead of at startup.
+ */
+class UriDispatcher
+{
+public:
+    static UriDispatcher& get();
+
+    /// Returns false if url-dispatcher couldn't be loaded
+    bool dispatch(const char* uri);
+
+    /// True once liburl-dispatcher has been loaded
+    bool is_loaded() const;
+
+private:
+    UriDispatcher() = default;
+    bool load();
+
+    typedef void (*DispatchCallback)(const char* uri, int success, void* user_data);
+    typedef void (*SendFunc)(const char* uri, DispatchCallback callback, void* user_data);
+    SendFunc m_send{nullptr};
+    bool m_load_failed{false};
+};
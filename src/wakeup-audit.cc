@@ -0,0 +1,160 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#include "wakeup-audit.h"
+
+#define REPORT_INTERVAL_SEC 60
+
+WakeupAudit& WakeupAudit::get()
+{
+    static WakeupAudit audit;
+    return audit;
+}
+
+const char* WakeupAudit::source_name(Source source)
+{
+    static const char* const names[N_SOURCES] = {"system-bus",  "system-bus-signal", "controller", "session-bus-call",
+                                                 "update",      "timer",             "audit",      "other"};
+
+    return names[source];
+}
+
+void WakeupAudit::enable()
+{
+    g_return_if_fail(!m_enabled);
+
+    m_enabled = true;
+    m_poll_func = g_main_context_get_poll_func(nullptr);
+    g_main_context_set_poll_func(nullptr, poll_func);
+    g_timeout_add_seconds(REPORT_INTERVAL_SEC, on_report_timer, this);
+}
+
+void WakeupAudit::watch_system_bus_context(GMainContext* context)
+{
+    auto& audit = get();
+
+    // every context starts out with the same poll function, g_poll()
+    audit.m_system_bus_poll_func = g_main_context_get_poll_func(context);
+    g_main_context_set_poll_func(context, system_bus_poll_func);
+}
+
+gint WakeupAudit::poll_func(GPollFD* fds, guint nfds, gint timeout_msec)
+{
+    auto& audit = get();
+
+    // a zero timeout is GLib checking for more work, not going to sleep
+    const bool may_sleep = timeout_msec != 0;
+
+    // if no one's claimed the last wakeup by the time we go back to sleep, no one will
+    if (may_sleep)
+    {
+        attribute(SOURCE_OTHER);
+    }
+
+    const auto ret = audit.m_poll_func(fds, nfds, timeout_msec);
+
+    if (may_sleep)
+    {
+        audit.m_unattributed = true;
+    }
+
+    return ret;
+}
+
+gint WakeupAudit::system_bus_poll_func(GPollFD* fds, guint nfds, gint timeout_msec)
+{
+    auto& audit = get();
+
+    const auto ret = audit.m_system_bus_poll_func.load()(fds, nfds, timeout_msec);
+
+    if ((timeout_msec != 0) && audit.m_enabled)
+    {
+        ++audit.m_counts[SOURCE_SYSTEM_BUS];
+    }
+
+    return ret;
+}
+
+gboolean WakeupAudit::on_report_timer(gpointer gself)
+{
+    attribute(SOURCE_AUDIT);
+    static_cast<WakeupAudit*>(gself)->report();
+    return G_SOURCE_CONTINUE;
+}
+
+void WakeupAudit::report()
+{
+    g_message("wakeups in the last %d seconds: %s", REPORT_INTERVAL_SEC, to_string().c_str());
+    for (auto& n : m_counts)
+    {
+        n = 0;
+    }
+}
+
+std::array<guint64, WakeupAudit::N_SOURCES> WakeupAudit::counts() const
+{
+    std::array<guint64, N_SOURCES> counts;
+    for (int i = 0; i < N_SOURCES; ++i)
+    {
+        counts[i] = m_counts[i];
+    }
+    return counts;
+}
+
+guint64 WakeupAudit::total() const
+{
+    guint64 total = 0;
+    for (const auto& n : m_counts)
+    {
+        total += n;
+    }
+    return total;
+}
+
+std::string WakeupAudit::to_string() const
+{
+    std::string str = "total=" + std::to_string(total());
+
+    const auto n = counts();
+    for (int i = 0; i < N_SOURCES; ++i)
+    {
+        if (n[i] != 0)
+        {
+            str += ' ';
+            str += source_name(Source(i));
+            str += '=';
+            str += std::to_string(n[i]);
+        }
+    }
+
+    return str;
+}
+
+GVariant* WakeupAudit::create_variant() const
+{
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a{st}"));
+
+    for (int i = 0; i < N_SOURCES; ++i)
+    {
+        g_variant_builder_add(&builder, "{st}", source_name(Source(i)), guint64(m_counts[i]));
+    }
+
+    return g_variant_builder_end(&builder);
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <string>
+
+#include <glib.h>
+
+/**
+ * Counts how often the main loop wakes up, and why, so that we can
+ * check the indicator stays within its power budget on an idle device.
+ *
+ * A wakeup is a return from a poll that was allowed to sleep. The
+ * callbacks that run because of it report what woke us with attribute();
+ * the first report after a wakeup gets the credit, and wakeups nobody
+ * claims are counted as "other" (e.g. GDBus serving exported objects).
+ * The location-service controller's thread is audited too: all it does
+ * is talk to the system bus, so each of its wakeups is counted as
+ * "system-bus" without asking its callbacks. The main loop wakeups that
+ * it causes when it hands over new state are counted as "controller".
+ *
+ * Off unless enable() is called. Once enabled, it logs the last
+ * minute's counts every minute; they're also available from Service's
+ * Debug interface.
+ */
+class WakeupAudit
+{
+public:
+    enum Source
+    {
+        SOURCE_SYSTEM_BUS,         // the location-service controller's thread
+        SOURCE_SYSTEM_BUS_SIGNAL,  // the screen service, e.g. DisplayPowerStateChange
+        SOURCE_CONTROLLER,         // state handed over by the location-service controller's thread
+        SOURCE_SESSION_BUS_CALL,   // a client calling us
+        SOURCE_UPDATE,             // Phone publishing state
+        SOURCE_TIMER,              // one of our own timeouts
+        SOURCE_AUDIT,              // our own once-a-minute report
+        SOURCE_OTHER,              // wakeups that no one claimed
+        N_SOURCES
+    };
+
+    static WakeupAudit& get();
+    static const char* source_name(Source source);
+
+    /// Starts counting wakeups of the default main context & any watched ones
+    void enable();
+
+    /// Counts each wakeup of 'context', which runs on a thread of its
+    /// own, as SOURCE_SYSTEM_BUS once the audit is enabled
+    static void watch_system_bus_context(GMainContext* context);
+
+    bool is_enabled() const
+    {
+        return m_enabled;
+    }
+
+    /// Credits the current wakeup to 'source', unless it's already been credited
+    static void attribute(Source source)
+    {
+        auto& audit = get();
+        if (audit.m_unattributed)
+        {
+            audit.m_unattributed = false;
+            ++audit.m_counts[source];
+        }
+    }
+
+    /// Wakeups by source since the last report
+    std::array<guint64, N_SOURCES> counts() const;
+    guint64 total() const;
+
+    /// "total=12 system-bus-signal=10 ...", skipping sources with no wakeups
+    std::string to_string() const;
+
+    /// Returns a floating a{st} of source name to wakeups since the last report
+    GVariant* create_variant() const;
+
+private:
+    static gint poll_func(GPollFD* fds, guint nfds, gint timeout_msec);
+    static gint system_bus_poll_func(GPollFD* fds, guint nfds, gint timeout_msec);
+    static gboolean on_report_timer(gpointer);
+    void report();
+
+    std::atomic<bool> m_enabled{false};
+    bool m_unattributed{false};
+    std::array<std::atomic<guint64>, N_SOURCES> m_counts{};  // the watched contexts' threads count too
+    GPollFunc m_poll_func{nullptr};
+    std::atomic<GPollFunc> m_system_bus_poll_func{nullptr};
+};
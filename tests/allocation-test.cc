@@ -0,0 +1,205 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+/**
+ * Counts the heap allocations on the steady-state update path and
+ * fails if they go over budget.
+ *
+ * malloc & friends are interposed for the whole process and forwarded
+ * to glibc; allocations are only counted while a test asks for them.
+ * Run with G_SLICE=always-malloc so that GSlice doesn't hide any.
+ */
+
+#include "controller-mock.h"
+#include "src/phone.h"
+#include "src/remote-property.h"
+#include "src/snapshot-handoff.h"
+#include "src/utils.h"  // GObjectDeleter
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+
+namespace
+{
+std::atomic<bool> counting{false};
+std::atomic<unsigned int> n_allocations{0};
+
+void count_allocation()
+{
+    if (counting.load(std::memory_order_relaxed))
+    {
+        n_allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+}
+
+extern "C" {
+void* __libc_malloc(size_t);
+void* __libc_calloc(size_t, size_t);
+void* __libc_realloc(void*, size_t);
+void __libc_free(void*);
+
+void* malloc(size_t size)
+{
+    count_allocation();
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size)
+{
+    count_allocation();
+    return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    count_allocation();
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr)
+{
+    __libc_free(ptr);
+}
+}
+
+class AllocationTest : public ::testing::Test
+{
+protected:
+    /* returns the mean number of allocations in each of 'n' calls to func */
+    static double allocations_per_call(unsigned int n, const std::function<void(unsigned int)>& func)
+    {
+        n_allocations = 0;
+        counting = true;
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            func(i);
+        }
+        counting = false;
+        return double(n_allocations) / n;
+    }
+};
+
+// decoding a value and setting a property with no listeners
+TEST_F(AllocationTest, RemotePropertyUpdate)
+{
+    RemoteProperty<bool> property{"IsOnline"};
+    GVariant* values[] = {g_variant_ref_sink(g_variant_new_boolean(false)),
+                          g_variant_ref_sink(g_variant_new_boolean(true))};
+
+    constexpr double BUDGET{0};
+    const auto allocs = allocations_per_call(1000, [&property, &values](unsigned int i)
+                                             {
+                                                 property.update(values[i % 2]);
+                                             });
+    EXPECT_LE(allocs, BUDGET);
+
+    for (auto& value : values)
+    {
+        g_variant_unref(value);
+    }
+}
+
+// the location-service controller handing a snapshot over to the main thread
+TEST_F(AllocationTest, SnapshotHandoff)
+{
+    struct Snapshot
+    {
+        bool value;
+        guint64 published_at;
+    };
+    typedef SnapshotHandoff<Snapshot, 8> Handoff;
+
+    // same thread for both ends, so that all of it is counted
+    auto worker_context = g_main_context_new();
+    core::Property<bool> property{false};
+    unsigned int n_received = 0;
+    std::unique_ptr<Handoff> handoff(new Handoff(worker_context, nullptr, [&property, &n_received](const Snapshot& s)
+                                                 {
+                                                     property.set(s.value);
+                                                     ++n_received;
+                                                 }));
+
+    auto hand_over = [&handoff](unsigned int i)
+    {
+        handoff->push(Snapshot{bool(i % 2), i});
+        g_main_context_iteration(nullptr, false);
+    };
+
+    // warm up so that GLib's one-time setup for the main loop isn't counted
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        hand_over(i);
+    }
+
+    constexpr double BUDGET{0};
+    const auto allocs = allocations_per_call(1000, hand_over);
+    EXPECT_LE(allocs, BUDGET);
+    EXPECT_EQ(1004u, n_received);
+
+    handoff.reset();
+    g_main_context_unref(worker_context);
+}
+
+// a controller change through Phone's flush to the action's new state
+TEST_F(AllocationTest, PhoneUpdate)
+{
+    auto controller = std::make_shared<MockController>();
+    std::shared_ptr<GSimpleActionGroup> action_group(g_simple_action_group_new(), GObjectDeleter());
+    std::unique_ptr<Phone> phone(new Phone(controller, action_group));
+    controller->set_location_service_enabled(true);  // so the header is visible
+    phone->refresh();
+
+    auto flip_gps = [&controller, &phone](unsigned int i)
+    {
+        controller->set_gps_enabled(i % 2);
+        phone->refresh();
+    };
+    auto flip_active = [&controller, &phone](unsigned int i)
+    {
+        controller->location_service_active().set(i % 2);
+        phone->refresh();
+    };
+
+    // warm up so that one-time work, e.g. building the cached header variants, isn't counted
+    for (unsigned int i = 0; i < 4; ++i)
+    {
+        flip_gps(i);
+        flip_active(i);
+    }
+
+    // Almost all of this is GObject's and properties-cpp's signal emission;
+    // our own code shouldn't allocate at all. Don't raise it without knowing why.
+    constexpr double BUDGET{16};
+    const auto published_before = phone->update_stats().published;
+    const auto gps_allocs = allocations_per_call(1000, flip_gps);
+    const auto header_allocs = allocations_per_call(1000, flip_active);
+    RecordProperty("gps_allocations_per_update", int(gps_allocs));
+    RecordProperty("header_allocations_per_update", int(header_allocs));
+    EXPECT_LE(gps_allocs, BUDGET);
+    EXPECT_LE(header_allocs, BUDGET);
+
+    // make sure every one of them was really published
+    EXPECT_EQ(published_before + 2000, phone->update_stats().published);
+
+    phone.reset();
+}
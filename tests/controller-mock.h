@@ -43,6 +43,10 @@ public:
     {
         return m_location_service_enabled;
     }
+    core::Property<bool>& location_service_active()
+    {
+        return m_location_service_active;
+    }
     const core::Property<bool>& location_service_active() const override
     {
         return m_location_service_active;
@@ -50,11 +54,50 @@ public:
 
     void set_gps_enabled(bool enabled) override
     {
-        m_gps_enabled = enabled;
+        if (m_fail_sets)
+        {
+            m_set_failed(Setting::GPS_ENABLED);
+        }
+        else if (!m_ignore_sets)
+        {
+            m_gps_enabled = enabled;
+        }
     }
     void set_location_service_enabled(bool enabled) override
     {
-        m_location_service_enabled = enabled;
+        if (m_fail_sets)
+        {
+            m_set_failed(Setting::LOCATION_SERVICE_ENABLED);
+        }
+        else if (!m_ignore_sets)
+        {
+            m_location_service_enabled = enabled;
+        }
+    }
+    const core::Signal<Setting>& set_failed() const override
+    {
+        return m_set_failed;
+    }
+
+    void request_activation() override
+    {
+        ++m_activation_requests;
+    }
+    unsigned int activation_requests() const
+    {
+        return m_activation_requests;
+    }
+
+    /// If true, set_*() requests fail instead of changing the setting
+    void set_fail_sets(bool fail)
+    {
+        m_fail_sets = fail;
+    }
+
+    /// If true, set_*() requests are dropped, as if the backend hadn't answered yet
+    void set_ignore_sets(bool ignore)
+    {
+        m_ignore_sets = ignore;
     }
 
 private:
@@ -62,4 +105,8 @@ private:
     core::Property<bool> m_gps_enabled{false};
     core::Property<bool> m_location_service_enabled{false};
     core::Property<bool> m_location_service_active{false};
+    core::Signal<Setting> m_set_failed;
+    bool m_fail_sets{false};
+    bool m_ignore_sets{false};
+    unsigned int m_activation_requests{0};
 };
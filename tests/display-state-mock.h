@@ -0,0 +1,41 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+#include <src/display-state.h>
+
+class MockDisplayState : public DisplayState
+{
+public:
+    MockDisplayState() = default;
+    virtual ~MockDisplayState() = default;
+
+    core::Property<bool>& is_on()
+    {
+        return m_is_on;
+    }
+    const core::Property<bool>& is_on() const override
+    {
+        return m_is_on;
+    }
+
+private:
+    core::Property<bool> m_is_on{true};
+};
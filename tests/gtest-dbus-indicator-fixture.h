@@ -91,6 +91,14 @@ protected:
         activate_subtree(G_MENU_MODEL(menu_model));
     }
 
+    // drop our references to the menu, as a client does when it closes
+    void unsubscribe_menu(void)
+    {
+        g_slist_free_full(menu_references, GDestroyNotify(g_object_unref));
+        menu_references = nullptr;
+        g_clear_object(&menu_model);
+    }
+
     GDBusMenuModel* menu_model;
     GDBusActionGroup* action_group;
     GTimer* timer;
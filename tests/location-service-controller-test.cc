@@ -0,0 +1,455 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#include "gtest-dbus-fixture.h"
+#include "location-service-mock.h"
+
+#include "src/location-service-controller.h"
+#include "src/metrics.h"
+
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+class LocationServiceControllerTest : public GTestDBusFixture
+{
+    typedef GTestDBusFixture super;
+
+protected:
+    std::shared_ptr<LocationServiceMock> myService;
+    std::shared_ptr<LocationServiceController> myController;
+
+    virtual void SetUp()
+    {
+        super::SetUp();
+
+        myService.reset(new LocationServiceMock(g_test_dbus_get_bus_address(test_dbus)));
+    }
+
+    virtual void TearDown()
+    {
+        myController.reset();
+        myService.reset();
+        wait_msec(100);
+
+        super::TearDown();
+    }
+
+    /* convenience func to loop until a condition is met */
+    bool wait_for(const std::function<bool()>& test, guint timeout_msec = 5000)
+    {
+        const auto deadline = g_get_monotonic_time() + timeout_msec * 1000;
+        while (!test() && (g_get_monotonic_time() < deadline))
+        {
+            wait_msec(10);
+        }
+        return test();
+    }
+};
+
+TEST_F(LocationServiceControllerTest, Bootstrap)
+{
+    myService->set_is_online(true);
+    myService->set_gps_enabled(true);
+    myService->set_state("active");
+    myService->own_name();
+
+    myController.reset(new LocationServiceController());
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->is_valid().get();
+                         }));
+
+    EXPECT_TRUE(myController->location_service_enabled().get());
+    EXPECT_TRUE(myController->gps_enabled().get());
+    EXPECT_TRUE(myController->location_service_active().get());
+}
+
+TEST_F(LocationServiceControllerTest, ChangesArriveOnTheMainThread)
+{
+    myService->own_name();
+    myController.reset(new LocationServiceController());
+
+    // the bus I/O happens elsewhere, but listeners must only be called from here
+    const auto main_thread = std::this_thread::get_id();
+    unsigned int n_changes = 0;
+    unsigned int n_elsewhere = 0;
+    auto on_changed = [main_thread, &n_changes, &n_elsewhere](bool)
+    {
+        ++n_changes;
+        if (std::this_thread::get_id() != main_thread)
+        {
+            ++n_elsewhere;
+        }
+    };
+    std::vector<core::ScopedConnection> connections;
+    connections.push_back(myController->is_valid().changed().connect(on_changed));
+    connections.push_back(myController->location_service_enabled().changed().connect(on_changed));
+
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->is_valid().get();
+                         }));
+    myService->set_is_online(true);
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->location_service_enabled().get();
+                         }));
+
+    EXPECT_EQ(2u, n_changes);
+    EXPECT_EQ(0u, n_elsewhere);
+}
+
+TEST_F(LocationServiceControllerTest, StaleReplyDoesNotRollBackSignal)
+{
+    // the service will answer Gets late, with the value it had when asked
+    myService->set_reply_delay_msec(300);
+    myService->own_name();
+    myController.reset(new LocationServiceController());
+
+    // wait for the controller to ask for the service's initial state...
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myService->properties_call_count() > 0;
+                         }));
+
+    // ...then change it before the (stale) reply goes out
+    myService->set_is_online(true);
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->is_valid().get();
+                         }));
+
+    // the PropertiesChanged value must win over the older reply
+    EXPECT_TRUE(myController->location_service_enabled().get());
+    EXPECT_EQ(1u, myController->stats().stale_replies_dropped);
+
+    // and it must stay that way once everything's settled
+    wait_msec(500);
+    EXPECT_TRUE(myController->location_service_enabled().get());
+}
+
+TEST_F(LocationServiceControllerTest, RapidSetsAreCoalesced)
+{
+    myService->own_name();
+    myController.reset(new LocationServiceController());
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->is_valid().get();
+                         }));
+
+    // make each Set round trip slow, then hammer the toggle
+    myService->set_reply_delay_msec(100);
+    constexpr unsigned int n_requests = 12;
+    bool enabled = myService->gps_enabled();
+    for (unsigned int i = 0; i < n_requests; ++i)
+    {
+        enabled = !enabled;
+        myController->set_gps_enabled(enabled);
+    }
+
+    // the service should end up with the last requested value...
+    ASSERT_TRUE(wait_for([this, enabled]()
+                         {
+                             return myController->gps_enabled().get() == enabled;
+                         }));
+    wait_msec(300);
+    EXPECT_EQ(enabled, myService->gps_enabled());
+    EXPECT_EQ(enabled, myController->gps_enabled().get());
+
+    // ...after only two round trips: the first request and the last one
+    const auto& stats = myController->stats();
+    EXPECT_EQ(n_requests, stats.set_requests);
+    EXPECT_EQ(2u, stats.sets_sent);
+    EXPECT_EQ(n_requests - 2, stats.sets_coalesced);
+}
+
+TEST_F(LocationServiceControllerTest, BrokenGetAllFallsBackToGet)
+{
+    myService->set_get_all_broken(true);
+    myService->set_is_online(true);
+    myService->set_state("active");
+    myService->own_name();
+
+    myController.reset(new LocationServiceController());
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->is_valid().get();
+                         }));
+
+    // one failed GetAll + three Gets
+    EXPECT_EQ(4u, myService->properties_call_count());
+    EXPECT_TRUE(myController->location_service_enabled().get());
+    EXPECT_FALSE(myController->gps_enabled().get());
+    EXPECT_TRUE(myController->location_service_active().get());
+}
+
+TEST_F(LocationServiceControllerTest, HungGetAllFallsBackToGet)
+{
+    myService->set_get_all_hangs(true);
+    myService->set_is_online(true);
+    myService->own_name();
+
+    // a GetAll that never answers mustn't hold us up for D-Bus' 25 s default
+    const auto start = g_get_monotonic_time();
+    myController.reset(new LocationServiceController());
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->is_valid().get();
+                         }));
+    EXPECT_GT(5 * G_USEC_PER_SEC, g_get_monotonic_time() - start);
+
+    // one unanswered GetAll + three Gets
+    EXPECT_EQ(4u, myService->properties_call_count());
+    EXPECT_TRUE(myController->location_service_enabled().get());
+}
+
+TEST_F(LocationServiceControllerTest, PropertiesChangedStorm)
+{
+    myService->own_name();
+    myController.reset(new LocationServiceController());
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->is_valid().get();
+                         }));
+
+    // count how often the controller's property changes during the storm
+    unsigned int n_changes = 0;
+    auto on_changed = [&n_changes](bool)
+    {
+        ++n_changes;
+    };
+    core::ScopedConnection connection = myController->location_service_active().changed().connect(on_changed);
+
+    constexpr guint n_events = 501;
+    myService->start_storm(LocationServiceMock::PROP_KEY_LOC_STATE, 1000, n_events);
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myService->storm_remaining() == 0;
+                         }));
+
+    // the controller must see every flip and end up in the service's final state
+    ASSERT_TRUE(wait_for([&n_changes]()
+                         {
+                             return n_changes == n_events;
+                         }));
+    EXPECT_EQ(myService->state() == "active", myController->location_service_active().get());
+}
+
+TEST_F(LocationServiceControllerTest, LazyAttachesToRunningService)
+{
+    myService->set_is_online(true);
+
+    // a lazy controller leaves the service alone until it shows up on its own
+    myController.reset(new LocationServiceController(true));
+    wait_msec(200);
+    EXPECT_FALSE(myController->is_valid().get());
+    EXPECT_EQ(0u, myService->properties_call_count());
+
+    myService->own_name();
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->is_valid().get();
+                         }));
+    EXPECT_TRUE(myController->location_service_enabled().get());
+
+    // once it's attached, activation requests are no-ops
+    myController->request_activation();
+    wait_msec(100);
+    EXPECT_TRUE(myController->is_valid().get());
+}
+
+TEST_F(LocationServiceControllerTest, SeedIsReplacedByService)
+{
+    myService->set_is_online(false);
+    myService->set_state("active");
+    myService->own_name();
+
+    // the seeded values are visible right away...
+    Controller::Snapshot seed;
+    seed.location_service_enabled = true;
+    seed.gps_enabled = true;
+    myController.reset(new LocationServiceController(false, &seed));
+    EXPECT_TRUE(myController->is_valid().get());
+    EXPECT_TRUE(myController->is_seeded().get());
+    EXPECT_TRUE(myController->location_service_enabled().get());
+    EXPECT_TRUE(myController->gps_enabled().get());
+
+    // ...until the service's own values arrive
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return !myController->location_service_enabled().get();
+                         }));
+    EXPECT_TRUE(myController->is_valid().get());
+    EXPECT_FALSE(myController->is_seeded().get());
+    EXPECT_FALSE(myController->gps_enabled().get());
+    EXPECT_TRUE(myController->location_service_active().get());
+}
+
+TEST_F(LocationServiceControllerTest, SeedExpiresWithoutService)
+{
+    // no location service, so the seed is only shown for the grace period
+    Controller::Snapshot seed;
+    seed.location_service_enabled = true;
+    myController.reset(new LocationServiceController(false, &seed));
+    EXPECT_TRUE(myController->is_valid().get());
+    EXPECT_TRUE(myController->is_seeded().get());
+
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return !myController->is_valid().get();
+                         }));
+    EXPECT_FALSE(myController->is_seeded().get());
+}
+
+TEST_F(LocationServiceControllerTest, SetBeforeBusIsHeld)
+{
+    myService->own_name();
+
+    // the controller doesn't have its bus yet, so this has to wait
+    myController.reset(new LocationServiceController());
+    unsigned int n_failures = 0;
+    core::ScopedConnection connection = myController->set_failed().connect([&n_failures](Controller::Setting)
+                                                                           {
+                                                                               ++n_failures;
+                                                                           });
+    myController->set_location_service_enabled(true);
+
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myService->is_online();
+                         }));
+    EXPECT_EQ(0u, n_failures);
+    EXPECT_EQ(1u, myController->stats().sets_sent);
+}
+
+TEST_F(LocationServiceControllerTest, InvalidatedPropertyIsRefetched)
+{
+    myService->own_name();
+    myController.reset(new LocationServiceController());
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->is_valid().get();
+                         }));
+    const auto n_calls_before = myService->properties_call_count();
+
+    // the service says GPS changed, but not what it changed to
+    myService->set_invalidate_only(true);
+    myService->set_gps_enabled(true);
+    EXPECT_TRUE(wait_for([this]()
+                         {
+                             return myController->gps_enabled().get();
+                         }));
+    EXPECT_EQ(1u, myController->stats().invalidations);
+    EXPECT_EQ(n_calls_before + 1, myService->properties_call_count());
+}
+
+TEST_F(LocationServiceControllerTest, OtherInterfacesAreIgnored)
+{
+    myService->own_name();
+    myController.reset(new LocationServiceController());
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->is_valid().get();
+                         }));
+    ASSERT_FALSE(myController->location_service_enabled().get());
+
+    // a PropertiesChanged from some other interface must not touch our state
+    myService->emit_foreign_properties_changed();
+    wait_msec(200);
+    EXPECT_FALSE(myController->location_service_enabled().get());
+    EXPECT_EQ(0u, myController->stats().invalidations);
+}
+
+TEST_F(LocationServiceControllerTest, ShortOutageIsHidden)
+{
+    myService->set_is_online(true);
+    myService->own_name();
+    myController.reset(new LocationServiceController());
+    myController->set_outage_grace_msec(1000);
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->is_valid().get();
+                         }));
+    unsigned int n_changes = 0;
+    core::ScopedConnection connection = myController->is_valid().changed().connect([&n_changes](bool)
+                                                                                   {
+                                                                                       ++n_changes;
+                                                                                   });
+
+    // the service restarts quickly, so the UI never hears about it
+    myService->release_name();
+    wait_msec(100);
+    myService->own_name();
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->stats().outages_hidden > 0;
+                         }));
+    EXPECT_EQ(0u, n_changes);
+    EXPECT_TRUE(myController->is_valid().get());
+
+    // but a longer outage does reach it
+    myService->release_name();
+    wait_msec(500);
+    EXPECT_TRUE(myController->is_valid().get());
+    EXPECT_TRUE(wait_for([this]()
+                         {
+                             return !myController->is_valid().get();
+                         }));
+    EXPECT_EQ(1u, n_changes);
+}
+
+TEST_F(LocationServiceControllerTest, FlappingServiceBacksOff)
+{
+    myService->set_is_online(true);
+    myService->own_name();
+    myController.reset(new LocationServiceController());
+    ASSERT_TRUE(wait_for([this]()
+                         {
+                             return myController->is_valid().get();
+                         }));
+    const auto n_calls_before = myService->properties_call_count();
+
+    // crash-loop; each flap doubles the wait, so keep it short
+    constexpr unsigned int n_cycles = 4;
+    for (unsigned int i = 0; i < n_cycles; ++i)
+    {
+        myService->release_name();
+        wait_msec(20);
+        myService->own_name();
+        wait_msec(20);
+    }
+
+    // after the first few flaps, the cycles were over before we bootstrapped
+    const auto& stats = myController->stats();
+    EXPECT_LT(0u, stats.backoffs);
+    EXPECT_LT(0u, stats.cycles_suppressed);
+    EXPECT_LE(stats.cycles_suppressed, Metrics::get().counter(Metrics::COUNTER_CYCLES_SUPPRESSED));
+    EXPECT_GT(n_cycles, myService->properties_call_count() - n_calls_before);
+
+    // once it settles down, we bootstrap again
+    myService->set_is_online(false);
+    EXPECT_TRUE(wait_for([this]()
+                         {
+                             return !myController->location_service_enabled().get();
+                         },
+                         10000));
+    EXPECT_TRUE(myController->is_valid().get());
+}
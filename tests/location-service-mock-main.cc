@@ -0,0 +1,185 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+/**
+ * A standalone com.ubuntu.location.Service for load and latency testing
+ * the indicator without a device.
+ *
+ * By default it joins the bus in $DBUS_SYSTEM_BUS_ADDRESS, or the bus that
+ * activated it if that's unset, so it can be started from a .service file.
+ * With --private-bus it brings up its own GTestDBus instead and prints that
+ * bus' address so the indicator can be pointed at it:
+ *
+ *   $ location-service-mock --private-bus --storm-property=State --storm-rate=500
+ *   DBUS_SYSTEM_BUS_ADDRESS=unix:abstract=/tmp/dbus-XXXX,guid=...
+ */
+
+#include <glib.h>
+#include <glib-unix.h>
+#include <gio/gio.h>
+
+#include <signal.h>
+#include <stdio.h>
+
+#include <memory>
+
+#include "location-service-mock.h"
+
+namespace
+{
+struct Options
+{
+    gboolean private_bus{false};
+    gboolean online{false};
+    gboolean gps{false};
+    gchar* state{nullptr};
+    gint reply_delay_msec{0};
+    gboolean get_all_broken{false};
+    gboolean get_all_hangs{false};
+    gchar* storm_property{nullptr};
+    gint storm_rate{100};
+    gint storm_count{1000};
+    gint storm_start_msec{1000};
+    gboolean exit_after_storm{false};
+};
+
+struct StormStart
+{
+    LocationServiceMock* service;
+    Options* options;
+    GMainLoop* loop;
+};
+
+gboolean on_storm_poll(gpointer gstart)
+{
+    auto start = static_cast<StormStart*>(gstart);
+    if (start->service->storm_remaining() > 0)
+    {
+        return G_SOURCE_CONTINUE;
+    }
+
+    g_message("storm finished: %u PropertiesChanged emitted", start->service->signals_emitted());
+    if (start->options->exit_after_storm)
+    {
+        g_main_loop_quit(start->loop);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+gboolean on_storm_start(gpointer gstart)
+{
+    auto start = static_cast<StormStart*>(gstart);
+    auto options = start->options;
+    g_message("starting storm: %d flips of '%s' at %d/sec", options->storm_count, options->storm_property,
+              options->storm_rate);
+    start->service->start_storm(options->storm_property, options->storm_rate, options->storm_count);
+    g_timeout_add(100, on_storm_poll, start);
+    return G_SOURCE_REMOVE;
+}
+
+gboolean on_quit_signal(gpointer gloop)
+{
+    g_main_loop_quit(static_cast<GMainLoop*>(gloop));
+    return G_SOURCE_REMOVE;
+}
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+    GOptionEntry entries[] = {
+        {"private-bus", 0, 0, G_OPTION_ARG_NONE, &options.private_bus, "Run on a private test bus", nullptr},
+        {"online", 0, 0, G_OPTION_ARG_NONE, &options.online, "Start with IsOnline set", nullptr},
+        {"gps", 0, 0, G_OPTION_ARG_NONE, &options.gps, "Start with DoesSatelliteBasedPositioning set", nullptr},
+        {"state", 0, 0, G_OPTION_ARG_STRING, &options.state, "Initial State (default: enabled)", "STATE"},
+        {"reply-delay", 0, 0, G_OPTION_ARG_INT, &options.reply_delay_msec, "Delay Properties replies", "MSEC"},
+        {"broken-getall", 0, 0, G_OPTION_ARG_NONE, &options.get_all_broken, "Make GetAll return an error", nullptr},
+        {"hung-getall", 0, 0, G_OPTION_ARG_NONE, &options.get_all_hangs, "Make GetAll never reply", nullptr},
+        {"storm-property", 0, 0, G_OPTION_ARG_STRING, &options.storm_property, "Property to storm", "NAME"},
+        {"storm-rate", 0, 0, G_OPTION_ARG_INT, &options.storm_rate, "Storm events per second (default: 100)", "N"},
+        {"storm-count", 0, 0, G_OPTION_ARG_INT, &options.storm_count, "Storm events in total (default: 1000)", "N"},
+        {"storm-start", 0, 0, G_OPTION_ARG_INT, &options.storm_start_msec, "Delay before storming (default: 1000)",
+         "MSEC"},
+        {"exit-after-storm", 0, 0, G_OPTION_ARG_NONE, &options.exit_after_storm, "Exit when the storm ends", nullptr},
+        {nullptr}};
+
+    GError* error = nullptr;
+    GOptionContext* context = g_option_context_new(nullptr);
+    g_option_context_set_summary(context, "A stand-in com.ubuntu.location.Service for testing");
+    g_option_context_add_main_entries(context, entries, nullptr);
+    if (!g_option_context_parse(context, &argc, &argv, &error))
+    {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        g_option_context_free(context);
+        return 1;
+    }
+    g_option_context_free(context);
+
+    GTestDBus* test_dbus = nullptr;
+    const gchar* address;
+    if (options.private_bus)
+    {
+        test_dbus = g_test_dbus_new(G_TEST_DBUS_NONE);
+        g_test_dbus_up(test_dbus);
+        address = g_test_dbus_get_bus_address(test_dbus);
+        printf("DBUS_SYSTEM_BUS_ADDRESS=%s\n", address);
+        fflush(stdout);
+    }
+    else if (((address = g_getenv("DBUS_SYSTEM_BUS_ADDRESS")) == nullptr) &&
+             ((address = g_getenv("DBUS_STARTER_ADDRESS")) == nullptr))
+    {
+        g_printerr("DBUS_SYSTEM_BUS_ADDRESS isn't set; refusing to run on the real system bus.\n");
+        g_printerr("Use --private-bus to start a private one.\n");
+        return 1;
+    }
+
+    auto loop = g_main_loop_new(nullptr, false);
+    g_unix_signal_add(SIGINT, on_quit_signal, loop);
+    g_unix_signal_add(SIGTERM, on_quit_signal, loop);
+
+    std::unique_ptr<LocationServiceMock> service(new LocationServiceMock(address));
+    service->set_reply_delay_msec(options.reply_delay_msec);
+    service->set_get_all_broken(options.get_all_broken);
+    service->set_get_all_hangs(options.get_all_hangs);
+    service->set_is_online(options.online);
+    service->set_gps_enabled(options.gps);
+    service->set_state(options.state != nullptr ? options.state : "enabled");
+    service->own_name();
+
+    StormStart storm_start{service.get(), &options, loop};
+    if (options.storm_property != nullptr)
+    {
+        g_timeout_add(options.storm_start_msec, on_storm_start, &storm_start);
+    }
+
+    g_main_loop_run(loop);
+
+    /* cleanup */
+    service.reset();
+    g_main_loop_unref(loop);
+    if (test_dbus != nullptr)
+    {
+        g_test_dbus_down(test_dbus);
+        g_object_unref(test_dbus);
+    }
+    g_free(options.state);
+    g_free(options.storm_property);
+    return 0;
+}
@@ -0,0 +1,471 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+/**
+ * A stand-in for ubuntu-location-service's com.ubuntu.location.Service.
+ *
+ * It connects to the bus at the given address on its own connection,
+ * so to LocationServiceController it looks like a separate peer.
+ * Properties replies can be delayed to provoke reply/signal races,
+ * GetAll can be made to fail or hang the way older location-services did,
+ * and PropertiesChanged storms can be scripted for load testing.
+ *
+ * See location-service-mock-main.cc for a standalone daemon wrapper.
+ */
+class LocationServiceMock
+{
+public:
+    explicit LocationServiceMock(const char* bus_address)
+    {
+        GError* error = nullptr;
+        auto flags = GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION);
+        m_bus = g_dbus_connection_new_for_address_sync(bus_address, flags, nullptr, nullptr, &error);
+        g_assert_no_error(error);
+
+        m_node_info = g_dbus_node_info_new_for_xml(INTROSPECTION_XML, &error);
+        g_assert_no_error(error);
+
+        // get_property and set_property are left unset so that
+        // org.freedesktop.DBus.Properties calls come to on_method_call()
+        // and can be answered late
+        static const GDBusInterfaceVTable vtable = {on_method_call, nullptr, nullptr};
+        auto iface_info = g_dbus_node_info_lookup_interface(m_node_info, IFACE_NAME);
+        m_registration_id =
+            g_dbus_connection_register_object(m_bus, OBJECT_PATH, iface_info, &vtable, this, nullptr, &error);
+        g_assert_no_error(error);
+    }
+
+    ~LocationServiceMock()
+    {
+        stop_storm();
+
+        // removing the source erases it from m_pending_replies
+        while (!m_pending_replies.empty())
+        {
+            g_source_remove(*m_pending_replies.begin());
+        }
+        for (auto invocation : m_hung_calls)
+        {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_NO_REPLY,
+                                                  "the location service went away");
+        }
+        m_hung_calls.clear();
+
+        release_name();
+        g_dbus_connection_unregister_object(m_bus, m_registration_id);
+        g_dbus_node_info_unref(m_node_info);
+        g_dbus_connection_close_sync(m_bus, nullptr, nullptr);
+        g_object_unref(m_bus);
+    }
+
+    LocationServiceMock(const LocationServiceMock&) = delete;
+    LocationServiceMock& operator=(const LocationServiceMock&) = delete;
+
+    void own_name()
+    {
+        g_return_if_fail(m_own_id == 0);
+        m_own_id = g_bus_own_name_on_connection(m_bus, BUS_NAME, G_BUS_NAME_OWNER_FLAGS_NONE, nullptr, nullptr,
+                                                nullptr, nullptr);
+    }
+
+    void release_name()
+    {
+        if (m_own_id != 0)
+        {
+            g_bus_unown_name(m_own_id);
+            m_own_id = 0;
+        }
+    }
+
+    /// Delay replies to Properties calls by this many msec.
+    /// The reply still carries the value as of when the call arrived.
+    void set_reply_delay_msec(guint msec)
+    {
+        m_reply_delay_msec = msec;
+    }
+
+    /// If true, GetAll returns an error so that clients have to fall back to Get
+    void set_get_all_broken(bool broken)
+    {
+        m_get_all_broken = broken;
+    }
+
+    /// If true, GetAll never answers, so that clients have to give up on it
+    void set_get_all_hangs(bool hangs)
+    {
+        m_get_all_hangs = hangs;
+    }
+
+    /// How many org.freedesktop.DBus.Properties calls we've received
+    unsigned int properties_call_count() const
+    {
+        return m_properties_call_count;
+    }
+
+    /// How many PropertiesChanged signals we've emitted
+    unsigned int signals_emitted() const
+    {
+        return m_signals_emitted;
+    }
+
+    bool is_online() const
+    {
+        return m_is_online;
+    }
+
+    bool gps_enabled() const
+    {
+        return m_gps_enabled;
+    }
+
+    void set_is_online(bool b)
+    {
+        m_is_online = b;
+        emit_properties_changed(PROP_KEY_LOC_ENABLED, g_variant_new_boolean(b));
+    }
+
+    void set_gps_enabled(bool b)
+    {
+        m_gps_enabled = b;
+        emit_properties_changed(PROP_KEY_GPS_ENABLED, g_variant_new_boolean(b));
+    }
+
+    void set_state(const char* state)
+    {
+        m_state = state;
+        emit_properties_changed(PROP_KEY_LOC_STATE, g_variant_new_string(state));
+    }
+
+    const std::string& state() const
+    {
+        return m_state;
+    }
+
+    /// If true, changes are announced by listing the property in
+    /// PropertiesChanged's invalidated_properties instead of sending its value
+    void set_invalidate_only(bool invalidate_only)
+    {
+        m_invalidate_only = invalidate_only;
+    }
+
+    /// Emit a PropertiesChanged for an interface that isn't ours,
+    /// as other objects on the service's bus connection might
+    void emit_foreign_properties_changed()
+    {
+        GVariantBuilder changed;
+        g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+        g_variant_builder_add(&changed, "{sv}", PROP_KEY_LOC_ENABLED, g_variant_new_boolean(!m_is_online));
+        g_dbus_connection_emit_signal(m_bus, nullptr, OBJECT_PATH, PROP_IFACE_NAME, "PropertiesChanged",
+                                      g_variant_new("(sa{sv}@as)", "com.ubuntu.location.Other", &changed,
+                                                    g_variant_new_strv(nullptr, 0)),
+                                      nullptr);
+    }
+
+    /***
+    ****  Storms
+    ***/
+
+    /// Flip the property named 'key' 'count' times at 'events_per_sec',
+    /// emitting a PropertiesChanged for each flip
+    void start_storm(const char* key, guint events_per_sec, guint count)
+    {
+        g_return_if_fail(events_per_sec > 0);
+
+        stop_storm();
+
+        // timers can't fire faster than once per msec, and may fire late,
+        // so each tick emits however many events the elapsed time calls for
+        m_storm_key = key;
+        m_storm_rate = events_per_sec;
+        m_storm_count = count;
+        m_storm_remaining = count;
+        m_storm_start = g_get_monotonic_time();
+        const guint interval_msec = MAX(1u, 1000u / events_per_sec);
+        m_storm_tag = g_timeout_add(interval_msec, on_storm_tick, this);
+    }
+
+    void stop_storm()
+    {
+        if (m_storm_tag != 0)
+        {
+            g_source_remove(m_storm_tag);
+            m_storm_tag = 0;
+        }
+        m_storm_remaining = 0;
+    }
+
+    /// How many events are left in the current storm
+    guint storm_remaining() const
+    {
+        return m_storm_remaining;
+    }
+
+    /// Flip the property named 'key' and emit a PropertiesChanged
+    void flip(const std::string& key)
+    {
+        if (key == PROP_KEY_LOC_ENABLED)
+        {
+            set_is_online(!m_is_online);
+        }
+        else if (key == PROP_KEY_GPS_ENABLED)
+        {
+            set_gps_enabled(!m_gps_enabled);
+        }
+        else if (key == PROP_KEY_LOC_STATE)
+        {
+            set_state(m_state == "active" ? "enabled" : "active");
+        }
+    }
+
+    static constexpr const char* BUS_NAME{"com.ubuntu.location.Service"};
+    static constexpr const char* OBJECT_PATH{"/com/ubuntu/location/Service"};
+    static constexpr const char* IFACE_NAME{"com.ubuntu.location.Service"};
+    static constexpr const char* PROP_IFACE_NAME{"org.freedesktop.DBus.Properties"};
+    static constexpr const char* PROP_KEY_LOC_ENABLED{"IsOnline"};
+    static constexpr const char* PROP_KEY_GPS_ENABLED{"DoesSatelliteBasedPositioning"};
+    static constexpr const char* PROP_KEY_LOC_STATE{"State"};
+
+private:
+    static constexpr const char* INTROSPECTION_XML{
+        "<node>"
+        "  <interface name='com.ubuntu.location.Service'>"
+        "    <property name='IsOnline' type='b' access='readwrite'/>"
+        "    <property name='DoesSatelliteBasedPositioning' type='b' access='readwrite'/>"
+        "    <property name='State' type='s' access='read'/>"
+        "  </interface>"
+        "</node>"};
+
+    static gboolean on_storm_tick(gpointer gself)
+    {
+        auto self = static_cast<LocationServiceMock*>(gself);
+
+        // catch up to where the requested rate says we should be
+        const guint64 elapsed_usec = g_get_monotonic_time() - self->m_storm_start;
+        const guint64 target = MIN(guint64(self->m_storm_rate) * elapsed_usec / G_USEC_PER_SEC, self->m_storm_count);
+        const guint64 emitted = self->m_storm_count - self->m_storm_remaining;
+        for (guint64 i = emitted; i < target; ++i)
+        {
+            self->flip(self->m_storm_key);
+            --self->m_storm_remaining;
+        }
+
+        if (self->m_storm_remaining == 0)
+        {
+            self->m_storm_tag = 0;
+            return G_SOURCE_REMOVE;
+        }
+
+        return G_SOURCE_CONTINUE;
+    }
+
+    void emit_properties_changed(const char* key, GVariant* value)
+    {
+        ++m_signals_emitted;
+
+        GVariantBuilder changed;
+        g_variant_builder_init(&changed, G_VARIANT_TYPE_VARDICT);
+        const char* invalidated[] = {key, nullptr};
+        if (m_invalidate_only)
+        {
+            g_variant_unref(g_variant_ref_sink(value));
+        }
+        else
+        {
+            g_variant_builder_add(&changed, "{sv}", key, value);
+            invalidated[0] = nullptr;
+        }
+        g_dbus_connection_emit_signal(m_bus, nullptr, OBJECT_PATH, PROP_IFACE_NAME, "PropertiesChanged",
+                                      g_variant_new("(sa{sv}@as)", IFACE_NAME, &changed,
+                                                    g_variant_new_strv(invalidated, -1)),
+                                      nullptr);
+    }
+
+    GVariant* get_property_value(const char* key) const
+    {
+        if (!g_strcmp0(key, PROP_KEY_LOC_ENABLED))
+        {
+            return g_variant_new_boolean(m_is_online);
+        }
+
+        if (!g_strcmp0(key, PROP_KEY_GPS_ENABLED))
+        {
+            return g_variant_new_boolean(m_gps_enabled);
+        }
+
+        if (!g_strcmp0(key, PROP_KEY_LOC_STATE))
+        {
+            return g_variant_new_string(m_state.c_str());
+        }
+
+        return nullptr;
+    }
+
+    GVariant* get_all_property_values() const
+    {
+        GVariantBuilder builder;
+        g_variant_builder_init(&builder, G_VARIANT_TYPE_VARDICT);
+        for (const auto& key : {PROP_KEY_LOC_ENABLED, PROP_KEY_GPS_ENABLED, PROP_KEY_LOC_STATE})
+        {
+            g_variant_builder_add(&builder, "{sv}", key, get_property_value(key));
+        }
+        return g_variant_builder_end(&builder);
+    }
+
+    /***
+    ****  Replies
+    ***/
+
+    struct PendingReply
+    {
+        LocationServiceMock* self;
+        GDBusMethodInvocation* invocation;
+        GVariant* reply;
+        guint tag;
+    };
+
+    void return_value(GDBusMethodInvocation* invocation, GVariant* reply)
+    {
+        if (m_reply_delay_msec == 0)
+        {
+            g_dbus_method_invocation_return_value(invocation, reply);
+            return;
+        }
+
+        auto pending = new PendingReply{this, invocation, g_variant_ref_sink(reply), 0};
+        pending->tag = g_timeout_add_full(G_PRIORITY_DEFAULT, m_reply_delay_msec, on_reply_timeout, pending,
+                                          delete_pending_reply);
+        m_pending_replies.insert(pending->tag);
+    }
+
+    static gboolean on_reply_timeout(gpointer gpending)
+    {
+        auto pending = static_cast<PendingReply*>(gpending);
+        g_dbus_method_invocation_return_value(pending->invocation, pending->reply);
+        pending->invocation = nullptr;  // return_value() took our ref
+        return G_SOURCE_REMOVE;
+    }
+
+    static void delete_pending_reply(gpointer gpending)
+    {
+        auto pending = static_cast<PendingReply*>(gpending);
+        pending->self->m_pending_replies.erase(pending->tag);
+        g_clear_object(&pending->invocation);
+        g_variant_unref(pending->reply);
+        delete pending;
+    }
+
+    static void on_method_call(GDBusConnection*,
+                               const gchar*,
+                               const gchar*,
+                               const gchar* interface_name,
+                               const gchar* method_name,
+                               GVariant* parameters,
+                               GDBusMethodInvocation* invocation,
+                               gpointer gself)
+    {
+        auto self = static_cast<LocationServiceMock*>(gself);
+
+        if (g_strcmp0(interface_name, PROP_IFACE_NAME))
+        {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD,
+                                                  "Unknown method %s.%s", interface_name, method_name);
+            return;
+        }
+
+        ++self->m_properties_call_count;
+
+        if (!g_strcmp0(method_name, "Get"))
+        {
+            const gchar* key{};
+            g_variant_get(parameters, "(&s&s)", nullptr, &key);
+            auto value = self->get_property_value(key);
+            if (value == nullptr)
+            {
+                g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_PROPERTY,
+                                                      "Unknown property %s", key);
+                return;
+            }
+            self->return_value(invocation, g_variant_new("(v)", value));
+        }
+        else if (!g_strcmp0(method_name, "GetAll") && self->m_get_all_hangs)
+        {
+            // keep the invocation so that the caller sees no reply, not an error
+            self->m_hung_calls.push_back(invocation);
+        }
+        else if (!g_strcmp0(method_name, "GetAll") && self->m_get_all_broken)
+        {
+            g_dbus_method_invocation_return_error(invocation, G_DBUS_ERROR, G_DBUS_ERROR_NOT_SUPPORTED,
+                                                  "GetAll is broken in this location service");
+        }
+        else if (!g_strcmp0(method_name, "GetAll"))
+        {
+            self->return_value(invocation, g_variant_new("(@a{sv})", self->get_all_property_values()));
+        }
+        else if (!g_strcmp0(method_name, "Set"))
+        {
+            const gchar* key{};
+            GVariant* value{};
+            g_variant_get(parameters, "(&s&sv)", nullptr, &key, &value);
+            if (!g_strcmp0(key, PROP_KEY_LOC_ENABLED))
+            {
+                self->set_is_online(g_variant_get_boolean(value));
+            }
+            else if (!g_strcmp0(key, PROP_KEY_GPS_ENABLED))
+            {
+                self->set_gps_enabled(g_variant_get_boolean(value));
+            }
+            g_variant_unref(value);
+            self->return_value(invocation, g_variant_new("()"));
+        }
+    }
+
+    GDBusConnection* m_bus{};
+    GDBusNodeInfo* m_node_info{};
+    guint m_registration_id{};
+    guint m_own_id{};
+    std::set<guint> m_pending_replies;
+    guint m_reply_delay_msec{};
+    bool m_get_all_broken{false};
+    bool m_get_all_hangs{false};
+    std::vector<GDBusMethodInvocation*> m_hung_calls;  // unanswered, so still ours to answer
+    bool m_invalidate_only{false};
+    unsigned int m_properties_call_count{};
+    unsigned int m_signals_emitted{};
+
+    std::string m_storm_key;
+    guint m_storm_tag{};
+    guint m_storm_rate{};
+    guint m_storm_count{};
+    guint m_storm_remaining{};
+    gint64 m_storm_start{};
+
+    bool m_is_online{false};
+    bool m_gps_enabled{false};
+    std::string m_state{"enabled"};
+};
@@ -0,0 +1,211 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#include "gtest-dbus-fixture.h"
+
+#include "src/menu-diff.h"
+
+#include <functional>
+
+class MenuDiffTest : public GTestDBusFixture
+{
+    typedef GTestDBusFixture super;
+
+protected:
+    static constexpr const char* MENU_PATH{"/com/canonical/indicator/location/test"};
+
+    GMenu* myMenu{};
+    guint myExportId{};
+    GDBusConnection* myClientBus{};
+    GMenuModel* myClientMenu{};
+    guint mySubscriptionId{};
+    unsigned int mySignalCount{};
+    unsigned int myItemsSent{};  // items removed + items added, over all the Changed signals
+
+    virtual void SetUp()
+    {
+        super::SetUp();
+
+        myMenu = g_menu_new();
+        GError* error = nullptr;
+        myExportId = g_dbus_connection_export_menu_model(conn, MENU_PATH, G_MENU_MODEL(myMenu), &error);
+        g_assert_no_error(error);
+
+        // watch the menu from a separate connection, the way a client would
+        auto flags = GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION);
+        myClientBus = g_dbus_connection_new_for_address_sync(g_test_dbus_get_bus_address(test_dbus), flags, nullptr,
+                                                             nullptr, &error);
+        g_assert_no_error(error);
+        mySubscriptionId = g_dbus_connection_signal_subscribe(myClientBus, nullptr, "org.gtk.Menus", "Changed",
+                                                              MENU_PATH, nullptr, G_DBUS_SIGNAL_FLAGS_NONE,
+                                                              on_menus_changed, this, nullptr);
+        myClientMenu = G_MENU_MODEL(g_dbus_menu_model_get(myClientBus, g_dbus_connection_get_unique_name(conn),
+                                                          MENU_PATH));
+        g_menu_model_get_n_items(myClientMenu);  // subscribe
+        wait_msec(100);
+    }
+
+    virtual void TearDown()
+    {
+        g_clear_object(&myClientMenu);
+        g_dbus_connection_signal_unsubscribe(myClientBus, mySubscriptionId);
+        g_dbus_connection_close_sync(myClientBus, nullptr, nullptr);
+        g_clear_object(&myClientBus);
+        g_dbus_connection_unexport_menu_model(conn, myExportId);
+        g_clear_object(&myMenu);
+
+        super::TearDown();
+    }
+
+    static void on_menus_changed(GDBusConnection*, const gchar*, const gchar*, const gchar*, const gchar*,
+                                 GVariant* parameters, gpointer gself)
+    {
+        auto self = static_cast<MenuDiffTest*>(gself);
+        ++self->mySignalCount;
+
+        GVariant* changes = g_variant_get_child_value(parameters, 0);
+        GVariantIter iter;
+        guint32 removed;
+        GVariant* added;
+        g_variant_iter_init(&iter, changes);
+        while (g_variant_iter_next(&iter, "(uuuu@aa{sv})", nullptr, nullptr, nullptr, &removed, &added))
+        {
+            self->myItemsSent += removed + g_variant_n_children(added);
+            g_variant_unref(added);
+        }
+        g_variant_unref(changes);
+    }
+
+    /* runs 'change' and returns how many items went out on the bus because of it */
+    unsigned int items_sent_by(const std::function<void()>& change)
+    {
+        mySignalCount = 0;
+        myItemsSent = 0;
+        change();
+        wait_msec(100);
+        return myItemsSent;
+    }
+
+    static MenuSpec create_spec(unsigned int n_items)
+    {
+        MenuSpec spec;
+        for (unsigned int i = 0; i < n_items; ++i)
+        {
+            auto label = std::string("Item ") + std::to_string(i);
+            spec.push_back({label, "indicator.item" + std::to_string(i), ""});
+        }
+        return spec;
+    }
+
+    /* confirms that what the client sees matches the spec */
+    void expect_client_menu(const MenuSpec& spec)
+    {
+        ASSERT_EQ(gint(spec.size()), g_menu_model_get_n_items(myClientMenu));
+        for (size_t i = 0; i < spec.size(); ++i)
+        {
+            gchar* label = nullptr;
+            g_menu_model_get_item_attribute(myClientMenu, i, G_MENU_ATTRIBUTE_LABEL, "s", &label);
+            EXPECT_EQ(spec[i].label, label);
+            g_free(label);
+        }
+    }
+};
+
+TEST_F(MenuDiffTest, EditsAreMinimal)
+{
+    // populate an empty menu
+    auto from = MenuSpec{};
+    auto to = create_spec(3);
+    auto stats = MenuDiff::apply(myMenu, from, to);
+    EXPECT_EQ(0u, stats.kept);
+    EXPECT_EQ(0u, stats.removed);
+    EXPECT_EQ(3u, stats.inserted);
+
+    // drop the middle item
+    from = to;
+    to.erase(to.begin() + 1);
+    stats = MenuDiff::apply(myMenu, from, to);
+    EXPECT_EQ(2u, stats.kept);
+    EXPECT_EQ(1u, stats.removed);
+    EXPECT_EQ(0u, stats.inserted);
+
+    // change the first item, append another
+    from = to;
+    to[0].label = "Changed";
+    to.push_back({"Appended", "indicator.appended", "com.canonical.indicator.switch"});
+    stats = MenuDiff::apply(myMenu, from, to);
+    EXPECT_EQ(1u, stats.kept);
+    EXPECT_EQ(1u, stats.removed);
+    EXPECT_EQ(2u, stats.inserted);
+
+    // the menu itself should match the spec
+    ASSERT_EQ(3, g_menu_model_get_n_items(G_MENU_MODEL(myMenu)));
+    gchar* type = nullptr;
+    EXPECT_TRUE(g_menu_model_get_item_attribute(G_MENU_MODEL(myMenu), 2, "x-canonical-type", "s", &type));
+    EXPECT_STREQ("com.canonical.indicator.switch", type);
+    g_free(type);
+    wait_msec(100);
+    expect_client_menu(to);
+}
+
+TEST_F(MenuDiffTest, UnchangedSpecSendsNothing)
+{
+    const auto spec = create_spec(5);
+    MenuDiff::apply(myMenu, MenuSpec{}, spec);
+    wait_msec(100);
+
+    EXPECT_EQ(0u, items_sent_by([this, &spec]()
+                                {
+                                    MenuDiff::apply(myMenu, spec, spec);
+                                }));
+    EXPECT_EQ(0u, mySignalCount);
+    expect_client_menu(spec);
+}
+
+TEST_F(MenuDiffTest, SmallerPayloadThanRebuild)
+{
+    auto spec = create_spec(5);
+    MenuDiff::apply(myMenu, MenuSpec{}, spec);
+    wait_msec(100);
+
+    // the old way: remove everything, then add it all back
+    auto changed = spec;
+    changed[2].label = "Changed";
+    const auto rebuild_items = items_sent_by([this, &changed]()
+                                             {
+                                                 g_menu_remove_all(myMenu);
+                                                 for (const auto& item_spec : changed)
+                                                 {
+                                                     GMenuItem* item = item_spec.create_item();
+                                                     g_menu_append_item(myMenu, item);
+                                                     g_object_unref(item);
+                                                 }
+                                             });
+    EXPECT_EQ(2 * changed.size(), rebuild_items);
+    expect_client_menu(changed);
+
+    // the diff only sends the item that changed
+    const auto diff_items = items_sent_by([this, &changed, &spec]()
+                                          {
+                                              MenuDiff::apply(myMenu, changed, spec);
+                                          });
+    EXPECT_EQ(2u, diff_items);  // one removed, one added
+    expect_client_menu(spec);
+}
@@ -22,8 +22,21 @@
 #include "gtest-dbus-indicator-fixture.h"
 
 #include "controller-mock.h"
+#include "display-state-mock.h"
+#include "unity-screen-mock.h"
 #include "src/dbus-shared.h"
 #include "src/service.h"
+#include "src/startup-timeline.h"
+#include "src/unity-screen-display-state.h"
+#include "src/uri-dispatcher.h"
+
+namespace
+{
+void on_action_state_changed(GActionGroup*, const gchar*, GVariant*, gpointer gcount)
+{
+    ++*static_cast<unsigned int*>(gcount);
+}
+}
 
 class PhoneTest : public GTestDBusIndicatorFixture
 {
@@ -361,3 +374,406 @@ TEST_F(PhoneTest, Header)
     g_clear_object(&dbus_menu_model);
     g_clear_object(&connection);
 }
+
+TEST_F(PhoneTest, PropertyStormIsCoalesced)
+{
+    // build a standalone phone so that we can look at its stats
+    auto controller = std::make_shared<MockController>();
+    std::shared_ptr<GSimpleActionGroup> ag(g_simple_action_group_new(), GObjectDeleter());
+    Phone phone(controller, ag);
+    unsigned int n_state_changes = 0;
+    auto handler_id =
+        g_signal_connect(ag.get(), "action-state-changed", G_CALLBACK(on_action_state_changed), &n_state_changes);
+
+    // hammer the controller with property changes in a single main loop iteration
+    constexpr int n_iters = 101;
+    for (int i = 0; i < n_iters; ++i)
+    {
+        controller->set_gps_enabled(!controller->gps_enabled().get());
+        controller->set_location_service_enabled(!controller->location_service_enabled().get());
+        controller->location_service_active().set(!controller->location_service_active().get());
+        controller->is_valid().set(!controller->is_valid().get());
+    }
+    EXPECT_EQ(0u, n_state_changes);
+    wait_msec();
+
+    // confirm it all went out in a single pass with one update per action
+    const auto& stats = phone.update_stats();
+    EXPECT_EQ(1u, stats.flushes);
+    EXPECT_EQ(3u, stats.published);
+    EXPECT_EQ(1u, stats.headers_skipped);  // is_valid ended up false, so the header is still hidden
+    EXPECT_EQ(7u * n_iters, stats.requested);
+    EXPECT_EQ(2u, n_state_changes);  // gps, location
+
+    // confirm the published state is the final state
+    auto v = g_action_group_get_action_state(G_ACTION_GROUP(ag.get()), "gps-detection-enabled");
+    EXPECT_EQ(controller->gps_enabled().get(), g_variant_get_boolean(v));
+    g_clear_pointer(&v, g_variant_unref);
+    v = g_action_group_get_action_state(G_ACTION_GROUP(ag.get()), "location-detection-enabled");
+    EXPECT_EQ(controller->location_service_enabled().get(), g_variant_get_boolean(v));
+    g_clear_pointer(&v, g_variant_unref);
+    EXPECT_EQ(controller->is_valid().get(),
+              g_action_group_get_action_enabled(G_ACTION_GROUP(ag.get()), "gps-detection-enabled"));
+
+    g_signal_handler_disconnect(ag.get(), handler_id);
+}
+
+TEST_F(PhoneTest, ActiveHoldAbsorbsFlaps)
+{
+    auto controller = std::make_shared<MockController>();
+    controller->is_valid().set(true);
+    controller->set_location_service_enabled(true);
+    std::shared_ptr<GSimpleActionGroup> ag(g_simple_action_group_new(), GObjectDeleter());
+    Phone phone(controller, ag);
+    phone.set_active_hold_msec(200);
+    unsigned int n_state_changes = 0;
+    auto handler_id = g_signal_connect(ag.get(), "action-state-changed::phone-header",
+                                       G_CALLBACK(on_action_state_changed), &n_state_changes);
+
+    // going active shows up right away
+    controller->location_service_active().set(true);
+    wait_msec(50);
+    EXPECT_EQ(1u, n_state_changes);
+
+    // an app polling every 20 msec doesn't make the header flap
+    constexpr unsigned int n_flaps = 5;
+    for (unsigned int i = 0; i < n_flaps; ++i)
+    {
+        controller->location_service_active().set(false);
+        wait_msec(20);
+        controller->location_service_active().set(true);
+        wait_msec(20);
+    }
+    EXPECT_EQ(1u, n_state_changes);
+    EXPECT_EQ(n_flaps, phone.update_stats().flaps_absorbed);
+
+    // going idle waits for the hold to expire
+    controller->location_service_active().set(false);
+    wait_msec(100);
+    EXPECT_EQ(1u, n_state_changes);
+    wait_msec(200);
+    EXPECT_EQ(2u, n_state_changes);
+    EXPECT_EQ(n_flaps, phone.update_stats().flaps_absorbed);
+
+    g_signal_handler_disconnect(ag.get(), handler_id);
+}
+
+TEST_F(PhoneTest, DisplayOffDefersUpdates)
+{
+    auto controller = std::make_shared<MockController>();
+    controller->is_valid().set(true);
+    controller->set_location_service_enabled(true);
+    std::shared_ptr<GSimpleActionGroup> ag(g_simple_action_group_new(), GObjectDeleter());
+    Phone phone(controller, ag);
+    auto display_state = std::make_shared<MockDisplayState>();
+    phone.set_display_state(display_state);
+    wait_msec();
+    unsigned int n_state_changes = 0;
+    auto handler_id =
+        g_signal_connect(ag.get(), "action-state-changed", G_CALLBACK(on_action_state_changed), &n_state_changes);
+
+    // while the display is off, nothing is published
+    display_state->is_on().set(false);
+    const auto stats = phone.update_stats();
+    for (int i = 0; i < 10; ++i)
+    {
+        controller->location_service_active().set(!controller->location_service_active().get());
+        controller->set_gps_enabled(!controller->gps_enabled().get());
+        wait_msec(10);
+    }
+    EXPECT_EQ(0u, n_state_changes);
+    EXPECT_EQ(stats.flushes, phone.update_stats().flushes);
+    EXPECT_EQ(stats.deferred + 30, phone.update_stats().deferred);  // header; gps & header
+
+    // when it comes back on, the latest state goes out in one pass
+    controller->location_service_active().set(true);
+    controller->set_gps_enabled(true);
+    display_state->is_on().set(true);
+    EXPECT_EQ(stats.flushes + 1, phone.update_stats().flushes);
+    EXPECT_EQ(2u, n_state_changes);  // header, gps
+    auto v = g_action_group_get_action_state(G_ACTION_GROUP(ag.get()), "gps-detection-enabled");
+    EXPECT_TRUE(g_variant_get_boolean(v));
+    g_clear_pointer(&v, g_variant_unref);
+
+    g_signal_handler_disconnect(ag.get(), handler_id);
+}
+
+TEST_F(PhoneTest, UnityScreenDisplayState)
+{
+    UnityScreenMock screen(g_test_dbus_get_bus_address(test_dbus));
+    screen.own_name();
+    UnityScreenDisplayState display_state;
+    wait_msec();
+    EXPECT_TRUE(display_state.is_on().get());
+
+    screen.set_display_on(false);
+    wait_msec();
+    EXPECT_FALSE(display_state.is_on().get());
+
+    screen.set_display_on(true);
+    wait_msec();
+    EXPECT_TRUE(display_state.is_on().get());
+
+    // if the screen service goes away while the display's off, assume it's on
+    screen.set_display_on(false);
+    wait_msec();
+    EXPECT_FALSE(display_state.is_on().get());
+    screen.release_name();
+    wait_msec();
+    EXPECT_TRUE(display_state.is_on().get());
+}
+
+TEST_F(PhoneTest, UnityScreenDisplayStateIsQueried)
+{
+    // the display's already off when we start
+    UnityScreenMock screen(g_test_dbus_get_bus_address(test_dbus));
+    screen.own_name();
+    screen.set_display_on(false);
+    UnityScreenDisplayState display_state;
+    wait_msec();
+    EXPECT_FALSE(display_state.is_on().get());
+
+    // and turns off while the screen service restarts
+    screen.release_name();
+    wait_msec();
+    EXPECT_TRUE(display_state.is_on().get());
+    screen.set_display_on(false);
+    screen.own_name();
+    wait_msec();
+    EXPECT_FALSE(display_state.is_on().get());
+}
+
+TEST_F(PhoneTest, ToggleFeedbackLatency)
+{
+    for (const bool optimistic : {false, true})
+    {
+        auto controller = std::make_shared<MockController>();
+        std::shared_ptr<GSimpleActionGroup> ag(g_simple_action_group_new(), GObjectDeleter());
+        Phone phone(controller, ag);
+        phone.set_optimistic_toggles(optimistic);
+        EXPECT_EQ(-1, phone.update_stats().last_toggle_latency_usec);
+
+        // in optimistic mode the switch moves before we get back to the main loop
+        g_action_group_activate_action(G_ACTION_GROUP(ag.get()), "gps-detection-enabled", nullptr);
+        auto v = g_action_group_get_action_state(G_ACTION_GROUP(ag.get()), "gps-detection-enabled");
+        EXPECT_EQ(optimistic, g_variant_get_boolean(v));
+        g_clear_pointer(&v, g_variant_unref);
+
+        // either way the switch ends up where the user put it
+        wait_msec();
+        v = g_action_group_get_action_state(G_ACTION_GROUP(ag.get()), "gps-detection-enabled");
+        EXPECT_TRUE(g_variant_get_boolean(v));
+        g_clear_pointer(&v, g_variant_unref);
+        EXPECT_TRUE(controller->gps_enabled().get());
+        EXPECT_LE(0, phone.update_stats().last_toggle_latency_usec);
+        EXPECT_EQ(0u, phone.update_stats().toggle_rollbacks);
+    }
+}
+
+TEST_F(PhoneTest, OptimisticToggleRollsBack)
+{
+    auto controller = std::make_shared<MockController>();
+    std::shared_ptr<GSimpleActionGroup> ag(g_simple_action_group_new(), GObjectDeleter());
+    Phone phone(controller, ag);
+    phone.set_optimistic_toggles(true);
+    controller->set_fail_sets(true);
+
+    // the switch moves right away...
+    g_action_group_activate_action(G_ACTION_GROUP(ag.get()), "location-detection-enabled", nullptr);
+    auto v = g_action_group_get_action_state(G_ACTION_GROUP(ag.get()), "location-detection-enabled");
+    EXPECT_TRUE(g_variant_get_boolean(v));
+    g_clear_pointer(&v, g_variant_unref);
+
+    // ...and moves back when the controller reports that the change failed
+    wait_msec();
+    v = g_action_group_get_action_state(G_ACTION_GROUP(ag.get()), "location-detection-enabled");
+    EXPECT_FALSE(g_variant_get_boolean(v));
+    g_clear_pointer(&v, g_variant_unref);
+    EXPECT_FALSE(controller->location_service_enabled().get());
+    EXPECT_EQ(1u, phone.update_stats().toggle_rollbacks);
+}
+
+TEST_F(PhoneTest, OptimisticDoubleTapIsNotRolledBack)
+{
+    auto controller = std::make_shared<MockController>();
+    std::shared_ptr<GSimpleActionGroup> ag(g_simple_action_group_new(), GObjectDeleter());
+    Phone phone(controller, ag);
+    phone.set_optimistic_toggles(true);
+    controller->set_ignore_sets(true);
+
+    // the second tap asks for the value that the controller already has
+    g_action_group_activate_action(G_ACTION_GROUP(ag.get()), "location-detection-enabled", nullptr);
+    g_action_group_activate_action(G_ACTION_GROUP(ag.get()), "location-detection-enabled", nullptr);
+    auto v = g_action_group_get_action_state(G_ACTION_GROUP(ag.get()), "location-detection-enabled");
+    EXPECT_FALSE(g_variant_get_boolean(v));
+    g_clear_pointer(&v, g_variant_unref);
+
+    // so there's nothing to time out
+    wait_msec(5500);
+    EXPECT_EQ(0u, phone.update_stats().toggle_rollbacks);
+}
+
+namespace
+{
+void on_debug_call_reply(GObject* source, GAsyncResult* res, gpointer gresult)
+{
+    GError* error = nullptr;
+    *static_cast<GVariant**>(gresult) = g_dbus_connection_call_finish(G_DBUS_CONNECTION(source), res, &error);
+    g_assert_no_error(error);
+}
+}
+
+TEST_F(PhoneTest, DebugHistograms)
+{
+    wait_msec();
+
+    // call a method on the service's Debug interface & wait for the reply
+    auto call_debug = [this](const char* method_name)
+    {
+        GVariant* result = nullptr;
+        g_dbus_connection_call(conn, INDICATOR_BUS_NAME, INDICATOR_OBJECT_PATH, INDICATOR_BUS_NAME ".Debug",
+                               method_name, nullptr, nullptr, G_DBUS_CALL_FLAGS_NONE, -1, nullptr,
+                               on_debug_call_reply, &result);
+        while (result == nullptr)
+        {
+            wait_msec(10);
+        }
+        return result;
+    };
+
+    // get the number of samples recorded for the named stage
+    auto get_count = [call_debug](const char* stage)
+    {
+        auto reply = call_debug("GetHistograms");
+        auto histograms = g_variant_get_child_value(reply, 0);
+        guint64 count = 0;
+        EXPECT_TRUE(g_variant_lookup(histograms, stage, "(ttt@at)", &count, nullptr, nullptr, nullptr));
+        g_variant_unref(histograms);
+        g_variant_unref(reply);
+        return count;
+    };
+
+    g_variant_unref(call_debug("Reset"));
+    EXPECT_EQ(0u, get_count("header-build"));
+    EXPECT_EQ(0u, get_count("export-emit"));
+
+    // a header change should pass through both of Phone's stages
+    myController->is_valid().set(true);
+    myController->set_location_service_enabled(true);
+    wait_msec();
+    EXPECT_LT(0u, get_count("header-build"));
+    EXPECT_LT(0u, get_count("export-emit"));
+    EXPECT_EQ(0u, get_count("signal-decode"));  // the mock controller doesn't decode any signals
+
+    g_variant_unref(call_debug("Reset"));
+    EXPECT_EQ(0u, get_count("header-build"));
+}
+
+TEST_F(PhoneTest, MenuSubscribersRequestActivation)
+{
+    // opening the menu asks the controller for real values;
+    // the fixture subscribed to it during SetUp
+    EXPECT_EQ(1u, myService->get_menu_subscribers().count().get());
+    EXPECT_LT(0u, myController->activation_requests());
+
+    // so does activating a switch
+    const auto n_requests = myController->activation_requests();
+    g_action_group_activate_action(G_ACTION_GROUP(action_group), "location-detection-enabled", nullptr);
+    wait_msec();
+    EXPECT_EQ(n_requests + 1, myController->activation_requests());
+}
+
+TEST_F(PhoneTest, IdleExit)
+{
+    auto on_idle_exit = [](Service*, void* gexited)
+    {
+        *static_cast<bool*>(gexited) = true;
+    };
+    bool exited = false;
+    myService->set_idle_exit(1, on_idle_exit, &exited);
+
+    // the fixture is subscribed to the menu, so the service stays
+    wait_msec(1500);
+    EXPECT_FALSE(exited);
+
+    // once it isn't, the service gives up its name
+    unsubscribe_menu();
+    wait_msec(2500);
+    EXPECT_TRUE(exited);
+    auto v = g_dbus_connection_call_sync(conn, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus",
+                                         "NameHasOwner", g_variant_new("(s)", INDICATOR_BUS_NAME),
+                                         G_VARIANT_TYPE("(b)"), G_DBUS_CALL_FLAGS_NONE, -1, nullptr, nullptr);
+    ASSERT_NE(nullptr, v);
+    gboolean has_owner = true;
+    g_variant_get(v, "(b)", &has_owner);
+    EXPECT_FALSE(has_owner);
+    g_variant_unref(v);
+}
+
+TEST_F(PhoneTest, IdleExitTimerDoesNotOutliveService)
+{
+    auto on_idle_exit = [](Service*, void*)
+    {
+    };
+    myService->set_idle_exit(1, on_idle_exit, nullptr);
+
+    // destroy the service while the fixture's still subscribed to the menu;
+    // dropping the subscriber on the way out mustn't arm a timer for it
+    EXPECT_EQ(1u, myService->get_menu_subscribers().count().get());
+    auto service = myService.get();
+    myService.reset();
+    EXPECT_EQ(nullptr, g_main_context_find_source_by_user_data(nullptr, service));
+}
+
+TEST_F(PhoneTest, SuspendedWhileUnsubscribed)
+{
+    const char* const key = "gps-detection-enabled";
+    auto& phone = myService->get_phone_profile();
+
+    // with no one subscribed, changes are held back
+    unsubscribe_menu();
+    wait_msec();
+    EXPECT_EQ(0u, myService->get_menu_subscribers().count().get());
+    const auto stats = phone.update_stats();
+    myController->set_gps_enabled(true);
+    wait_msec();
+    EXPECT_EQ(stats.published, phone.update_stats().published);
+    EXPECT_LT(stats.deferred, phone.update_stats().deferred);
+    GVariant* v = g_action_group_get_action_state(G_ACTION_GROUP(action_group), key);
+    ASSERT_TRUE(v != nullptr);
+    EXPECT_FALSE(g_variant_get_boolean(v));
+    g_variant_unref(v);
+
+    // and published in one pass when a client subscribes
+    auto menu = g_dbus_menu_model_get(conn, INDICATOR_BUS_NAME, INDICATOR_OBJECT_PATH "/" INDICATOR_PROFILE);
+    g_menu_model_get_n_items(G_MENU_MODEL(menu));
+    wait_for_action_state_change(key);
+    EXPECT_EQ(1u, myService->get_menu_subscribers().count().get());
+    EXPECT_EQ(stats.flushes + 1, phone.update_stats().flushes);
+    v = g_action_group_get_action_state(G_ACTION_GROUP(action_group), key);
+    ASSERT_TRUE(v != nullptr);
+    EXPECT_TRUE(g_variant_get_boolean(v));
+    g_variant_unref(v);
+    g_object_unref(menu);
+}
+
+TEST_F(PhoneTest, StartupTimeline)
+{
+    // the fixture's service is up, exported and showing real values
+    auto& timeline = StartupTimeline::get();
+    EXPECT_LE(0, timeline.elapsed(StartupTimeline::SESSION_BUS_ACQUIRED));
+    EXPECT_LE(0, timeline.elapsed(StartupTimeline::EXPORTED));
+    EXPECT_LE(0, timeline.elapsed(StartupTimeline::FIRST_ACCURATE_HEADER));
+    EXPECT_LE(timeline.elapsed(StartupTimeline::SESSION_BUS_ACQUIRED), timeline.elapsed(StartupTimeline::EXPORTED));
+
+    // the location-service milestones don't apply to the mock controller
+    EXPECT_EQ(-1, timeline.elapsed(StartupTimeline::SERVICE_APPEARED));
+    EXPECT_EQ(std::string::npos, timeline.to_string().find("service-appeared"));
+    EXPECT_NE(std::string::npos, timeline.to_string().find("exported="));
+}
+
+TEST_F(PhoneTest, UrlDispatcherIsLoadedOnDemand)
+{
+    // nothing at startup should need url-dispatcher
+    EXPECT_FALSE(UriDispatcher::get().is_loaded());
+}
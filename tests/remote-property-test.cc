@@ -0,0 +1,106 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#include "src/remote-property.h"
+
+#include <gtest/gtest.h>
+
+namespace
+{
+enum class Color
+{
+    UNKNOWN,
+    RED,
+    GREEN
+};
+
+struct ColorNames
+{
+    typedef Color value_type;
+    static const EnumValue<Color> (&values())[2]
+    {
+        static const EnumValue<Color> table[] = {{"red", Color::RED}, {"green", Color::GREEN}};
+        return table;
+    }
+    static Color fallback()
+    {
+        return Color::UNKNOWN;
+    }
+};
+}
+
+TEST(RemotePropertyTest, UpdatesFromVariant)
+{
+    RemoteProperty<bool> property{"IsOnline"};
+    EXPECT_STREQ("IsOnline", property.name());
+    EXPECT_FALSE(property.get());
+
+    unsigned int n_changes = 0;
+    core::ScopedConnection connection = property.changed().connect([&n_changes](bool)
+                                                                   {
+                                                                       ++n_changes;
+                                                                   });
+
+    GVariant* value = g_variant_ref_sink(g_variant_new_boolean(true));
+    EXPECT_TRUE(property.update(value));
+    EXPECT_TRUE(property.get());
+    EXPECT_EQ(1, property.as_int());
+    EXPECT_EQ(1u, n_changes);
+
+    // same value again; nothing to tell anyone
+    EXPECT_TRUE(property.update(value));
+    EXPECT_EQ(1u, n_changes);
+    g_variant_unref(value);
+}
+
+TEST(RemotePropertyTest, RejectsWrongType)
+{
+    RemoteProperty<bool> property{"IsOnline", true};
+
+    GVariant* value = g_variant_ref_sink(g_variant_new_string("true"));
+    EXPECT_FALSE(property.accepts(value));
+    EXPECT_FALSE(property.update(value));
+    EXPECT_TRUE(property.get());
+    g_variant_unref(value);
+
+    RemoteProperty<guint32> count{"Count"};
+    value = g_variant_ref_sink(g_variant_new_int32(7));
+    EXPECT_FALSE(count.update(value));
+    EXPECT_EQ(0u, count.get());
+    g_variant_unref(value);
+}
+
+TEST(RemotePropertyTest, DecodesEnums)
+{
+    RemoteProperty<Color, EnumDecoder<ColorNames>> property{"Color"};
+
+    const struct
+    {
+        const char* str;
+        Color expected;
+    } tests[] = {{"green", Color::GREEN}, {"red", Color::RED}, {"purple", Color::UNKNOWN}, {"", Color::UNKNOWN}};
+
+    for (const auto& test : tests)
+    {
+        GVariant* value = g_variant_ref_sink(g_variant_new_string(test.str));
+        EXPECT_TRUE(property.update(value));
+        EXPECT_EQ(int(test.expected), property.as_int()) << test.str;
+        g_variant_unref(value);
+    }
+}
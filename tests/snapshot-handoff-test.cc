@@ -0,0 +1,152 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#include "src/snapshot-handoff.h"
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+class SnapshotHandoffTest : public ::testing::Test
+{
+protected:
+    typedef SnapshotHandoff<unsigned int, 4> Handoff;
+
+    GMainContext* producer_context{};
+    std::vector<unsigned int> received;
+
+    void SetUp() override
+    {
+        producer_context = g_main_context_new();
+    }
+
+    void TearDown() override
+    {
+        g_main_context_unref(producer_context);
+    }
+
+    std::unique_ptr<Handoff> create_handoff()
+    {
+        // the consumer is the default context, i.e. this thread's
+        return std::unique_ptr<Handoff>(new Handoff(producer_context, nullptr, [this](const unsigned int& value)
+                                                    {
+                                                        received.push_back(value);
+                                                    }));
+    }
+
+    void run_until_empty(const Handoff& handoff)
+    {
+        while (!handoff.is_empty())
+        {
+            g_main_context_iteration(producer_context, false);
+            g_main_context_iteration(nullptr, false);
+        }
+    }
+};
+
+TEST_F(SnapshotHandoffTest, DeliversInOrder)
+{
+    auto handoff = create_handoff();
+
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        handoff->push(i);
+    }
+    EXPECT_FALSE(handoff->is_empty());
+    EXPECT_TRUE(received.empty());  // not until the consumer's context runs
+
+    run_until_empty(*handoff);
+    EXPECT_EQ(std::vector<unsigned int>({0, 1, 2}), received);
+}
+
+TEST_F(SnapshotHandoffTest, CoalescesWhenFull)
+{
+    auto handoff = create_handoff();
+
+    // the first four fill the ring; the rest are coalesced into the latest
+    for (unsigned int i = 0; i < 10; ++i)
+    {
+        handoff->push(i);
+    }
+
+    run_until_empty(*handoff);
+    EXPECT_EQ(std::vector<unsigned int>({0, 1, 2, 3, 9}), received);
+
+    // and once there's room again, nothing's coalesced
+    received.clear();
+    handoff->push(10);
+    handoff->push(11);
+    run_until_empty(*handoff);
+    EXPECT_EQ(std::vector<unsigned int>({10, 11}), received);
+}
+
+TEST_F(SnapshotHandoffTest, ConsumerCanDestroyIt)
+{
+    std::unique_ptr<Handoff> handoff;
+    handoff.reset(new Handoff(producer_context, nullptr, [this, &handoff](const unsigned int& value)
+                              {
+                                  received.push_back(value);
+                                  handoff.reset();
+                              }));
+
+    handoff->push(1);
+    handoff->push(2);
+    for (int i = 0; (handoff != nullptr) && (i < 10); ++i)
+    {
+        g_main_context_iteration(nullptr, false);
+    }
+    EXPECT_EQ(nullptr, handoff);
+    EXPECT_EQ(std::vector<unsigned int>({1}), received);
+}
+
+TEST_F(SnapshotHandoffTest, AcrossThreads)
+{
+    constexpr unsigned int n_values{20000};
+    auto handoff = create_handoff();
+
+    std::thread producer([this, &handoff]()
+                         {
+                             g_main_context_push_thread_default(producer_context);
+                             for (unsigned int i = 1; i <= n_values; ++i)
+                             {
+                                 handoff->push(i);
+                                 g_main_context_iteration(producer_context, false);
+                             }
+                             while (!handoff->is_empty())
+                             {
+                                 g_main_context_iteration(producer_context, false);
+                                 g_usleep(100);
+                             }
+                             g_main_context_pop_thread_default(producer_context);
+                         });
+
+    while (received.empty() || (received.back() != n_values))
+    {
+        g_main_context_iteration(nullptr, true);
+    }
+    producer.join();
+
+    // some may have been coalesced, but never reordered or repeated
+    for (size_t i = 1; i < received.size(); ++i)
+    {
+        EXPECT_LT(received[i - 1], received[i]);
+    }
+}
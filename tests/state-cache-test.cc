@@ -0,0 +1,134 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#include "src/state-cache.h"
+
+#include <glib/gstdio.h>
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+class StateCacheTest : public ::testing::Test
+{
+protected:
+    gchar* myDir{nullptr};
+    std::string myFilename;
+
+    virtual void SetUp()
+    {
+        myDir = g_dir_make_tmp("state-cache-test-XXXXXX", nullptr);
+        ASSERT_NE(nullptr, myDir);
+        gchar* filename = g_build_filename(myDir, "subdir", "state", nullptr);
+        myFilename = filename;
+        g_free(filename);
+    }
+
+    virtual void TearDown()
+    {
+        g_remove(myFilename.c_str());
+        gchar* subdir = g_path_get_dirname(myFilename.c_str());
+        g_rmdir(subdir);
+        g_free(subdir);
+        g_rmdir(myDir);
+        g_clear_pointer(&myDir, g_free);
+    }
+};
+
+TEST_F(StateCacheTest, RoundTrip)
+{
+    Controller::Snapshot snapshot;
+    EXPECT_FALSE(StateCache(myFilename).load(snapshot));
+
+    for (int i = 0; i < 8; ++i)
+    {
+        Controller::Snapshot saved;
+        saved.location_service_enabled = (i & 1) != 0;
+        saved.gps_enabled = (i & 2) != 0;
+        saved.location_service_active = (i & 4) != 0;
+        {
+            StateCache cache(myFilename);
+            cache.save(saved);
+        }  // flushes
+
+        Controller::Snapshot loaded;
+        ASSERT_TRUE(StateCache(myFilename).load(loaded));
+        EXPECT_EQ(saved.location_service_enabled, loaded.location_service_enabled);
+        EXPECT_EQ(saved.gps_enabled, loaded.gps_enabled);
+        EXPECT_FALSE(loaded.location_service_active);  // transient, so never saved
+    }
+}
+
+TEST_F(StateCacheTest, ActiveIsNotRestored)
+{
+    gchar* subdir = g_path_get_dirname(myFilename.c_str());
+    g_mkdir_with_parents(subdir, 0700);
+    g_free(subdir);
+
+    // a file from a build that saved the "active" bit
+    const std::string contents("ILOC\x01\x07\x00\x00", 8);
+    ASSERT_TRUE(g_file_set_contents(myFilename.c_str(), contents.data(), contents.size(), nullptr));
+
+    Controller::Snapshot loaded;
+    ASSERT_TRUE(StateCache(myFilename).load(loaded));
+    EXPECT_TRUE(loaded.location_service_enabled);
+    EXPECT_TRUE(loaded.gps_enabled);
+    EXPECT_FALSE(loaded.location_service_active);
+}
+
+TEST_F(StateCacheTest, SavesAreThrottled)
+{
+    StateCache cache(myFilename);
+    Controller::Snapshot snapshot;
+    snapshot.location_service_enabled = true;
+    cache.save(snapshot);
+    snapshot.gps_enabled = true;
+    cache.save(snapshot);
+
+    // nothing's written until the throttle expires or we flush
+    EXPECT_FALSE(g_file_test(myFilename.c_str(), G_FILE_TEST_EXISTS));
+    cache.flush();
+
+    Controller::Snapshot loaded;
+    ASSERT_TRUE(StateCache(myFilename).load(loaded));
+    EXPECT_TRUE(loaded.location_service_enabled);
+    EXPECT_TRUE(loaded.gps_enabled);
+    EXPECT_FALSE(loaded.location_service_active);
+}
+
+TEST_F(StateCacheTest, IgnoresBadFiles)
+{
+    gchar* subdir = g_path_get_dirname(myFilename.c_str());
+    g_mkdir_with_parents(subdir, 0700);
+    g_free(subdir);
+
+    auto load = [this](const std::string& contents)
+    {
+        EXPECT_TRUE(g_file_set_contents(myFilename.c_str(), contents.data(), contents.size(), nullptr));
+        Controller::Snapshot snapshot;
+        return StateCache(myFilename).load(snapshot);
+    };
+
+    EXPECT_TRUE(load(std::string("ILOC\x01\x07\x00\x00", 8)));
+    EXPECT_FALSE(load(std::string("")));
+    EXPECT_FALSE(load(std::string("ILOC")));                         // truncated
+    EXPECT_FALSE(load(std::string("ILOC\x01\x07\x00\x00\x00", 9)));  // too long
+    EXPECT_FALSE(load(std::string("XLOC\x01\x07\x00\x00", 8)));      // wrong magic
+    EXPECT_FALSE(load(std::string("ILOC\x02\x07\x00\x00", 8)));      // unknown version
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2016 Canonical Ltd.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Authors:
+ *   Charles Kerr <charles.kerr@canonical.com>
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <gio/gio.h>
+
+/**
+ * A stand-in for unity-system-compositor's com.canonical.Unity.Screen,
+ * or at least for the parts that we use: the DisplayPowerStateChange
+ * signal and the getDisplayPowerState method.
+ *
+ * Like LocationServiceMock, it's a separate peer on its own connection.
+ */
+class UnityScreenMock
+{
+public:
+    explicit UnityScreenMock(const char* bus_address)
+    {
+        GError* error = nullptr;
+        auto flags = GDBusConnectionFlags(G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+                                          G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION);
+        m_bus = g_dbus_connection_new_for_address_sync(bus_address, flags, nullptr, nullptr, &error);
+        g_assert_no_error(error);
+
+        m_node_info = g_dbus_node_info_new_for_xml(INTROSPECTION_XML, &error);
+        g_assert_no_error(error);
+
+        static const GDBusInterfaceVTable vtable = {on_method_call, nullptr, nullptr};
+        auto iface_info = g_dbus_node_info_lookup_interface(m_node_info, IFACE_NAME);
+        m_registration_id =
+            g_dbus_connection_register_object(m_bus, OBJECT_PATH, iface_info, &vtable, this, nullptr, &error);
+        g_assert_no_error(error);
+    }
+
+    ~UnityScreenMock()
+    {
+        release_name();
+        g_dbus_connection_unregister_object(m_bus, m_registration_id);
+        g_dbus_node_info_unref(m_node_info);
+        g_dbus_connection_close_sync(m_bus, nullptr, nullptr);
+        g_object_unref(m_bus);
+    }
+
+    UnityScreenMock(const UnityScreenMock&) = delete;
+    UnityScreenMock& operator=(const UnityScreenMock&) = delete;
+
+    void own_name()
+    {
+        g_return_if_fail(m_own_id == 0);
+        m_own_id = g_bus_own_name_on_connection(m_bus, BUS_NAME, G_BUS_NAME_OWNER_FLAGS_NONE, nullptr, nullptr,
+                                                nullptr, nullptr);
+    }
+
+    void release_name()
+    {
+        if (m_own_id != 0)
+        {
+            g_bus_unown_name(m_own_id);
+            m_own_id = 0;
+        }
+    }
+
+    /// Emit DisplayPowerStateChange as the screen turns on or off
+    void set_display_on(bool on)
+    {
+        m_display_on = on;
+
+        const gint32 reason = 0;  // unknown
+        GError* error = nullptr;
+        g_dbus_connection_emit_signal(m_bus, nullptr, OBJECT_PATH, IFACE_NAME, "DisplayPowerStateChange",
+                                      g_variant_new("(ii)", power_state(), reason), &error);
+        g_assert_no_error(error);
+        g_dbus_connection_flush_sync(m_bus, nullptr, nullptr);
+    }
+
+    static constexpr const char* BUS_NAME{"com.canonical.Unity.Screen"};
+    static constexpr const char* OBJECT_PATH{"/com/canonical/Unity/Screen"};
+    static constexpr const char* IFACE_NAME{"com.canonical.Unity.Screen"};
+
+private:
+    static constexpr const char* INTROSPECTION_XML{
+        "<node>"
+        "  <interface name='com.canonical.Unity.Screen'>"
+        "    <method name='getDisplayPowerState'>"
+        "      <arg type='i' name='state' direction='out'/>"
+        "    </method>"
+        "    <signal name='DisplayPowerStateChange'>"
+        "      <arg type='i' name='state'/>"
+        "      <arg type='i' name='reason'/>"
+        "    </signal>"
+        "  </interface>"
+        "</node>"};
+
+    gint32 power_state() const
+    {
+        return m_display_on ? 1 : 0;
+    }
+
+    static void on_method_call(GDBusConnection*,
+                               const gchar*,
+                               const gchar*,
+                               const gchar*,
+                               const gchar* /*method_name*/,
+                               GVariant*,
+                               GDBusMethodInvocation* invocation,
+                               gpointer gself)
+    {
+        // getDisplayPowerState is the only method in the introspection data
+        auto self = static_cast<UnityScreenMock*>(gself);
+        g_dbus_method_invocation_return_value(invocation, g_variant_new("(i)", self->power_state()));
+    }
+
+    GDBusConnection* m_bus{nullptr};
+    GDBusNodeInfo* m_node_info{nullptr};
+    guint m_registration_id{0};
+    guint m_own_id{0};
+    bool m_display_on{true};
+};